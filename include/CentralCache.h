@@ -1,6 +1,9 @@
 #pragma once
 #include "Common.h"
+#include "PageCache.h"
 #include <mutex>
+#include <atomic>
+#include <cstdint>
 
 class CentralCache
 {
@@ -11,30 +14,93 @@ public:
         return instance;
     }
 
-    void* fetchRange(size_t index, size_t batchNum);
-    void returnRange(void* start, size_t returnNum, size_t index);
+    // 取一批块：首尾写到 start/end，返回块数（0 表示没内存了）
+    // 最多 batchNum 块；transfer cache 命中时整批拿走，可能比 batchNum 少
+    size_t fetchRange(size_t index, size_t batchNum, void*& start, void*& end);
+
+    // 还一串已经串好的块，首尾和块数由调用方给出；比一批长的切成几批存放
+    void returnRange(void* start, void* end, size_t count, size_t index);
+
+    // 把 transfer cache 里缓存的批次全部拆回span（trim 时用）
+    void flushTransferCaches();
+
+    // 每档统计：读的时候拿一下这一档的锁数span里的空闲块
+    struct ClassStats
+    {
+        size_t spans;          // 这一档切着的span数
+        size_t freeBlocks;     // span里还没交出去的块
+        size_t transferBlocks; // transfer cache 里的块
+    };
+    ClassStats classStats(size_t index);
 
 private:
-    // 相互是还所有原子指针为nullptr
+    using Span = PageCache::Span;
+
     CentralCache()
     {
-        for (auto& ptr : centralFreeList_)
+        for (auto& head : spanLists_)
         {
-            ptr.store(nullptr, std::memory_order_relaxed);
+            head = nullptr;
         }
-        // 初始化所有锁
-        for (auto& lock : locks_)
+        // 一开始所有槽都在空槽栈上
+        for (auto& tc : transfer_)
         {
-            lock.clear();
+            for (uint32_t slot = 0; slot < TRANSFER_SLOTS; ++slot)
+            {
+                pushSlot(tc, tc.empty, slot);
+            }
         }
     }
-    // 从页缓存获取内存
-    void* fetchFromPageCache(size_t size);
+
+    // 从页缓存获取一个span，并切成 index 档大小的小块
+    Span* fetchFromPageCache(size_t index);
+
+    // transfer cache 没命中时的慢路径：从span里摘块 / 逐块还回所属span
+    size_t fetchFromSpans(size_t index, size_t batchNum, void*& start, void*& end);
+    void returnToSpans(void* start, size_t count, size_t index);
+
+    // span链表的插入/摘除
+    void pushSpan(size_t index, Span* span);
+    void unlinkSpan(size_t index, Span* span);
 
 private:
-    // 中心缓存的自由链表
-    std::array<std::atomic<void*>, FREE_LIST_SIZE> centralFreeList_;
+    // 一批串好的块，首尾和块数都已知，整批搬动不用再沿链表数一遍
+    struct Batch
+    {
+        void*  head;
+        void*  tail;
+        size_t count;
+        std::atomic<uint32_t> next; // 所在无锁栈里下一个槽（槽号 + 1，0 表示没有）
+    };
+
+    // transfer cache：每档一个小数组，缓存线程之间来回搬的整批块
+    // 还回来的块按这一档的批大小切成批放进来，下一个来取的线程整批拿走
+    // 槽在两个无锁栈之间流转：空槽栈和装着批次的满槽栈，拿放都只是几次 CAS，同一档的并发存取互不阻塞
+    static constexpr size_t   TRANSFER_SLOTS = 16;
+    static constexpr size_t   TRANSFER_BYTES = 512 * 1024; // 每档最多缓存这么多字节的块（软上限）
+    static constexpr uint32_t NO_SLOT = UINT32_MAX;
+
+    struct TransferCache
+    {
+        std::array<Batch, TRANSFER_SLOTS> slots{};
+        // 栈顶：高 32 位是版本号，每次修改加一，防止 ABA；低 32 位是槽号 + 1，0 表示栈空
+        std::atomic<uint64_t> full{0};
+        std::atomic<uint64_t> empty{0};
+        std::atomic<size_t>   blocks{0}; // 满槽里一共多少块
+    };
+
+    static uint32_t popSlot(TransferCache& tc, std::atomic<uint64_t>& top);
+    static void pushSlot(TransferCache& tc, std::atomic<uint64_t>& top, uint32_t slot);
+
+    std::array<TransferCache, FREE_LIST_SIZE> transfer_;
+
+    // 中心缓存按span管理内存块：每档一条“还有空闲块”的span双向链表
+    // 块归还时按地址找回所属span，span里的块全部空闲后整个还给 PageCache 合并复用
+    std::array<Span*, FREE_LIST_SIZE> spanLists_;
+
+    // 每档切着的span数（含已经被掏空、不在链表上的），由 locks_ 保护
+    std::array<size_t, FREE_LIST_SIZE> spanCounts_{};
 
     // 用于同步的自旋锁
-    std::array<std::atomic_flag, FREE_LIST_SIZE> locks_;
+    std::array<SpinLock, FREE_LIST_SIZE> locks_;
 };
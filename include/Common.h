@@ -3,41 +3,178 @@
 #include <atomic>
 #include <algorithm>
 #include <array>
+#include <thread>
 
 // 对齐数大小
 constexpr size_t ALIGNMENT = 16;
 
-//一个界限，大于64KB就调用系统malloc，小于就用内存池
+//一个界限，大于它的按页交给 LargeCache/PageCache 整块分配，小于等于的按 size-class 切块
 constexpr size_t MAX_BYTES = 256 * 1024;
 
 // 每次从PageCache获取span大小（以页为单位）
  constexpr size_t SPAN_PAGES = 8;
 
  constexpr size_t PAGE_SIZE = 4096; // 4K页大小
+ constexpr size_t PAGE_SHIFT = 12;  // log2(PAGE_SIZE)，地址右移得到页号
+ static_assert(PAGE_SIZE == (size_t(1) << PAGE_SHIFT), "PAGE_SHIFT must match PAGE_SIZE");
 
 //constexpr size_t SMALL_MAX = SPAN_PAGES * PAGE_SIZE; // 8页 * 4KB = 32KB
 
-constexpr size_t FREE_LIST_SIZE = MAX_BYTES / ALIGNMENT; // ALIGNMENT等于指针void*的大小
+// 自旋锁：和 CentralCache 里的用法一致，抢不到就让出CPU，满足 BasicLockable 可配合 std::lock_guard
+class SpinLock
+{
+public:
+    void lock()
+    {
+        while (flag_.test_and_set(std::memory_order_acquire))
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    void unlock()
+    {
+        flag_.clear(std::memory_order_release);
+    }
+
+private:
+    std::atomic_flag flag_ = ATOMIC_FLAG_INIT;
+};
+
+// 几何级数的 size-class 表（tcmalloc 风格）
+// 128B 以内按 16B 步长：16, 32, ..., 128 共 8 档；
+// 之后每翻一倍再细分 8 档，步长为该区间起点的 1/8：144, 160, ..., 256, 288, ..., 512, ...
+// 这样相邻两档之间最大浪费 < 1/9（约 11%），一直到 MAX_BYTES 共 8 + 11 * 8 = 96 档
+constexpr size_t SMALL_CLASS_MAX   = 128;  // 线性区间上界
+constexpr size_t CLASSES_PER_GROUP = 8;    // 每翻一倍细分的档数
+
+namespace detail
+{
+    constexpr size_t log2Floor(size_t x)
+    {
+        return sizeof(size_t) * 8 - 1 - static_cast<size_t>(__builtin_clzl(x));
+    }
+
+    // 第 index 档的块大小，闭式计算
+    constexpr size_t classSizeAt(size_t index)
+    {
+        if (index < SMALL_CLASS_MAX / ALIGNMENT)
+            return (index + 1) * ALIGNMENT;
+        size_t group = (index - SMALL_CLASS_MAX / ALIGNMENT) / CLASSES_PER_GROUP;
+        size_t step  = (index - SMALL_CLASS_MAX / ALIGNMENT) % CLASSES_PER_GROUP + 1;
+        size_t base  = SMALL_CLASS_MAX << group;
+        return base + (base / CLASSES_PER_GROUP) * step;
+    }
+
+    constexpr size_t countClasses()
+    {
+        size_t n = 0;
+        while (classSizeAt(n) < MAX_BYTES) ++n;
+        return n + 1;
+    }
+}
+
+// 每个线程/中心缓存需要的自由链表条数 == size-class 的数量
+constexpr size_t FREE_LIST_SIZE = detail::countClasses();
+
+static_assert(detail::classSizeAt(FREE_LIST_SIZE - 1) == MAX_BYTES, "last size class must be MAX_BYTES");
+
+// 每个 size-class 的静态信息
+struct SizeClassInfo
+{
+    size_t size;  // 块大小
+    size_t pages; // 每次向PageCache申请的span页数
+    size_t batch; // 前端和中心缓存之间一批搬多少块
+};
+
+namespace detail
+{
+    // 选一个span页数：小块至少 SPAN_PAGES 页，然后加页直到尾部切不出整块的浪费 <= 1/8
+    constexpr size_t classPagesFor(size_t size)
+    {
+        size_t pages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+        if (pages < SPAN_PAGES) pages = SPAN_PAGES;
+        while ((pages * PAGE_SIZE) % size > (pages * PAGE_SIZE) / 8) ++pages;
+        return pages;
+    }
+
+    // 计算批量获取内存块的数量
+    // 基准：每次批量获取不超过4KB内存
+    constexpr size_t classBatchFor(size_t size)
+    {
+        if (size <= 32) return 128;   // 128 * 32 = 4KB
+        if (size <= 64) return 64;    // 64 * 64 = 4KB
+        if (size <= 128) return 32;   // 32 * 128 = 4KB
+        if (size <= 256) return 16;   // 16 * 256 = 4KB
+        if (size <= 512) return 8;    // 8 * 512 = 4KB
+        if (size <= 1024) return 4;   // 4 * 1024 = 4KB
+        return 2;                     // 大于1024的对象每次取2个
+    }
+
+    constexpr std::array<SizeClassInfo, FREE_LIST_SIZE> buildClassTable()
+    {
+        std::array<SizeClassInfo, FREE_LIST_SIZE> table{};
+        for (size_t i = 0; i < FREE_LIST_SIZE; ++i)
+        {
+            table[i].size  = classSizeAt(i);
+            table[i].pages = classPagesFor(table[i].size);
+            table[i].batch = classBatchFor(table[i].size);
+        }
+        return table;
+    }
+}
+
+inline constexpr std::array<SizeClassInfo, FREE_LIST_SIZE> SIZE_CLASS_TABLE = detail::buildClassTable();
 
 // 大小类管理
 class SizeClass 
 {
 public:
-    //其实就是把要分配的内存，对齐到比它大的内存块，方便分配
-    //如 申请1字节，就会分配8字节；申请12字节，就会分配16字节；真正分配的是对齐数的整数倍
-    //这能很好的避免外部碎片，但是无法避免内部碎片
-    static size_t roundUp(size_t bytes)
+    //把要分配的内存，向上取到所在 size-class 的块大小
+    //如 申请1字节，分配16字节；申请130字节，分配144字节；申请1000字节，分配1024字节
+    //相邻档位按几何级数分布，内部碎片控制在 1/8 左右
+    static constexpr size_t roundUp(size_t bytes)
     {
-        return (bytes + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+        return classSize(getIndex(bytes));
     }
 
-    //这是根据申请的内存大小，找到数组对应的位置
-    //如，申请1个字节，实际上是分配了8个字节，而这个8个字节的内存块，全部都在第一个位置，也就是index=0的位置
-    static size_t getIndex(size_t bytes)
+    //根据申请的内存大小，O(1) 找到对应的 size-class 下标
+    //128B 以内：(bytes + 15) / 16 - 1
+    //更大的：先用 clz 定位所在的“翻倍区间”，再按 1/8 步长定位区间内的档位
+    static constexpr size_t getIndex(size_t bytes)
     {   
-        // 确保bytes至少为ALIGNMENT
-        bytes = std::max(bytes, ALIGNMENT);
-        // 向上取整后-1
-        return (bytes + ALIGNMENT - 1) / ALIGNMENT - 1;
+        if (bytes <= SMALL_CLASS_MAX)
+        {
+            // 确保bytes至少为ALIGNMENT
+            bytes = std::max(bytes, ALIGNMENT);
+            // 向上取整后-1
+            return (bytes + ALIGNMENT - 1) / ALIGNMENT - 1;
+        }
+        size_t group = detail::log2Floor(bytes - 1) - detail::log2Floor(SMALL_CLASS_MAX);
+        size_t base  = SMALL_CLASS_MAX << group;
+        size_t shift = detail::log2Floor(base / CLASSES_PER_GROUP);
+        size_t step  = ((bytes - base + (size_t(1) << shift) - 1) >> shift) - 1;
+        return SMALL_CLASS_MAX / ALIGNMENT + group * CLASSES_PER_GROUP + step;
+    }
+
+    // 第 index 档的块大小
+    static constexpr size_t classSize(size_t index)
+    {
+        return SIZE_CLASS_TABLE[index].size;
+    }
+
+    // 第 index 档每个span的页数
+    static constexpr size_t classPages(size_t index)
+    {
+        return SIZE_CLASS_TABLE[index].pages;
+    }
+
+    // 第 index 档一批的块数：ThreadCache 慢启动增长到的一次取块数，也是 transfer cache 里一批的上限
+    static constexpr size_t classBatch(size_t index)
+    {
+        return SIZE_CLASS_TABLE[index].batch;
     }
 };
+
+static_assert(SizeClass::getIndex(1) == 0 && SizeClass::getIndex(MAX_BYTES) == FREE_LIST_SIZE - 1,
+              "size class lookup out of range");
@@ -0,0 +1,107 @@
+#pragma once
+#include "Common.h"
+#include <atomic>
+#include <array>
+
+namespace detail
+{
+    constexpr size_t CPU_CLASS_BYTES = 32 * 1024; // 每个 CPU 每档最多缓存的字节数
+    constexpr size_t CPU_MAX_SLOTS   = 128;       // 每档最多缓存的块数
+
+    // 每 CPU slab 的布局：每档在 slab 里的偏移和槽数，编译期算好
+    struct CpuSlabLayout
+    {
+        std::array<size_t, FREE_LIST_SIZE> offset{};
+        std::array<size_t, FREE_LIST_SIZE> capacity{};
+        size_t bytes = 0;
+    };
+
+    constexpr CpuSlabLayout makeCpuSlabLayout()
+    {
+        CpuSlabLayout layout;
+        for (size_t i = 0; i < FREE_LIST_SIZE; ++i)
+        {
+            // 小块最多 CPU_MAX_SLOTS 个，大块至少留 1 个
+            size_t cap = CPU_CLASS_BYTES / SizeClass::classSize(i);
+            cap = cap < 1 ? 1 : (cap > CPU_MAX_SLOTS ? CPU_MAX_SLOTS : cap);
+
+            layout.offset[i]   = layout.bytes;
+            layout.capacity[i] = cap;
+            layout.bytes += sizeof(void*) * (1 + cap);
+        }
+        return layout;
+    }
+}
+
+// 每 CPU 前端缓存（Linux rseq），用来替代 thread_local 的 ThreadCache：缓存总量只和核数有关，和线程数无关
+// 每个 CPU 一块 slab，slab 里每个 size-class 一个指针栈：[块数][槽0][槽1]...
+// 压栈/弹栈都在 rseq 临界区里完成，线程中途被抢占或迁移时内核让它从头重来，不需要锁和原子指令
+// 编译时没有打开 MEMORYPOOL_PERCPU，或者运行时 glibc 没有注册 rseq，就不能打开，继续用 ThreadCache
+class CpuCache
+{
+public:
+    // 打开/关闭每 CPU 缓存；rseq 不可用时打开失败，返回 false
+    // 关闭后已经缓存在各 CPU 上的块不会还回去（最多每核几 MB）
+    static bool setEnabled(bool enabled);
+    static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+    // 当前进程能不能用 rseq
+    static bool available();
+
+    static void* allocate(size_t size);
+    static void deallocate(void* ptr, size_t size);
+    static void deallocate(void* ptr);
+
+    // 已知 size-class 的快路径
+    static void* allocateClass(size_t index)
+    {
+        void* ptr = pop(index);
+        return ptr ? ptr : refill(index);
+    }
+
+    static void deallocateClass(void* ptr, size_t index)
+    {
+        freeToCpu(index, ptr);
+    }
+
+    // 所有 CPU 上缓存着的字节数（不停下别的 CPU 去数，只是近似值）
+    static size_t cachedBytes();
+
+    // 每档向中心缓存取（栈空）和还（栈满）的次数；快路径上不计数，逐块的分配/释放次数只有线程缓存前端有
+    struct ClassStats
+    {
+        size_t refills;
+        size_t overflows;
+    };
+    static ClassStats classStats(size_t index);
+
+private:
+    static constexpr detail::CpuSlabLayout LAYOUT = detail::makeCpuSlabLayout();
+    // 每个 CPU 的 slab 按 2 的幂对齐，临界区里用移位从 CPU 号算出 slab 地址
+    static constexpr size_t SLAB_SHIFT = detail::log2Floor(LAYOUT.bytes - 1) + 1;
+
+    static bool init();
+
+    // rseq 临界区：在当前 CPU 的 slab 上弹出/压入一块，栈空返回 nullptr / 栈满返回 false
+    static void* pop(size_t index);
+    static bool push(size_t index, void* ptr);
+
+    // 当前 CPU 栈空：从中心缓存取一批，一块给用户，其余压栈
+    static void* refill(size_t index);
+
+    // 当前 CPU 栈满：连同 ptr 弹出一半还给中心缓存
+    static void overflow(size_t index, void* ptr);
+
+    static void freeToCpu(size_t index, void* ptr)
+    {
+        if (!push(index, ptr)) overflow(index, ptr);
+    }
+
+    // 只在慢路径上更新
+    static inline std::array<std::atomic<size_t>, FREE_LIST_SIZE> refills_{};
+    static inline std::array<std::atomic<size_t>, FREE_LIST_SIZE> overflows_{};
+
+    static inline std::atomic<bool> enabled_{false};
+    static inline char*  slabs_   = nullptr; // numCpus_ 块 slab，按需缺页
+    static inline size_t numCpus_ = 0;
+};
@@ -0,0 +1,93 @@
+#pragma once
+#include "Common.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// 采样堆分析器，默认关闭，MemoryPool::startHeapProfiler() 打开：
+// 每个线程记着离下一次采样还差多少字节，间隔服从均值为 sampleBytes 的几何（指数）分布，快路径上只减一个线程本地计数；
+// 减到头的那次分配走慢路径，记下调用栈，按调用栈汇总成 pprof 能读的堆剖面（heap_v2 文本格式）
+//
+// 采样到的小对象不放在普通 span 里，而是单独占采样区里的几页：带大小的释放不查页表，
+// 只有这样才能用一次地址区间比较认出它，知道它被释放了；大对象原地不动，span 上打个标记，释放时 LargeCache 通知这里
+class HeapProfiler
+{
+public:
+    static constexpr size_t DEFAULT_SAMPLE_BYTES = 2 * 1024 * 1024;
+
+    // 打开/关闭采样；采样区映射失败时返回 false
+    // 已经在跑的线程要等手里这段间隔（关闭时最多 DISABLED_INTERVAL 字节）用完才开始采样
+    static bool start(size_t sampleBytes = DEFAULT_SAMPLE_BYTES);
+    static void stop();
+    static bool running() { return enabled_.load(std::memory_order_relaxed); }
+
+    // 快路径：这次分配要不要采样
+    static bool shouldSample(size_t size)
+    {
+        if (size < bytesUntilSample_)
+        {
+            bytesUntilSample_ -= size;
+            return false;
+        }
+        return true;
+    }
+
+    // 慢路径：重新抽下一次采样的间隔，采样这次分配并返回内存
+    // 不采样（没打开、本线程正在采样或导出、采样区满了）返回 nullptr，调用方照常分配
+    static void* allocate(size_t size);
+
+    // 批量分配用：shouldSample(size * n) 成立时，采样点前面还有几块不用采样（最多 n - 1），要在 allocate 之前问
+    static size_t blocksBeforeSample(size_t size, size_t n)
+    {
+        return std::min(bytesUntilSample_ / std::max<size_t>(size, 1), n - 1);
+    }
+
+    // 采样区按自身大小对齐，地址右移 REGION_SHIFT 位就是它的编号，释放路径上只比一次
+    static constexpr size_t REGION_SHIFT = 32;
+
+    // ptr 是不是采样区里的小对象；没打开过时编号是任何地址都移不出来的值，总是 false
+    static bool owns(const void* ptr)
+    {
+        return (reinterpret_cast<uintptr_t>(ptr) >> REGION_SHIFT) == regionTag_.load(std::memory_order_relaxed);
+    }
+
+    // 打开过（采样区已经映射）；没打开过就不可能有采样对象
+    static bool regionMapped() { return regionTag_.load(std::memory_order_relaxed) != NO_REGION; }
+
+    // 采样区里的小对象
+    static void deallocate(void* ptr);
+    static size_t usableSize(const void* ptr);
+
+    // 采样到的大对象被释放（span 上带着标记）
+    static void recordFree(void* ptr);
+
+    // pprof 的 heap_v2 文本格式，末尾附上 /proc/self/maps 供符号化
+    // heapProfile 只列还有活着的采样的调用栈；allocationProfile 列出打开以来所有采样过的调用栈
+    // 两者都同时带着在用和累计分配两组数，pprof 用 -sample_index 选
+    static std::string heapProfile();
+    static std::string allocationProfile();
+
+    // 按采样记的数（没有按采样率放大）
+    struct Stats
+    {
+        size_t sampleBytes;
+        size_t liveSamples;
+        size_t liveBytes;
+        size_t totalSamples;
+        size_t totalBytes;
+    };
+    static Stats stats();
+
+private:
+    static constexpr size_t DISABLED_INTERVAL = 1024 * 1024; // 关闭时隔这么多字节才看一眼开关
+
+    static std::string dump(bool liveOnly);
+
+    static inline std::atomic<bool>      enabled_{false};
+    static constexpr uintptr_t NO_REGION = UINTPTR_MAX;
+    static inline std::atomic<uintptr_t> regionTag_{NO_REGION};
+
+    // 本线程离下一次采样还差的字节数，新线程从 0 开始，第一次分配就去看一眼开关
+    static inline thread_local size_t bytesUntilSample_ = 0;
+};
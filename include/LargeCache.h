@@ -0,0 +1,83 @@
+#pragma once
+#include "Common.h"
+#include "PageCache.h"
+#include <array>
+#include <mutex>
+
+// 大对象（> MAX_BYTES）缓存：大对象直接按页从 PageCache 要span，
+// 释放后先按大小分桶留一小批在这里，下次同样大小的请求直接复用已经映射、已经缺过页的内存
+class LargeCache
+{
+public:
+    static LargeCache& getInstance()
+    {
+        static LargeCache instance;
+        return instance;
+    }
+
+    // 大对象统计
+    struct Stats
+    {
+        size_t inUseSpans;  // 正在被用户使用的大对象个数
+        size_t inUseBytes;
+        size_t cachedSpans; // 缓存里等待复用的
+        size_t cachedBytes;
+        size_t hits;        // 从缓存命中的分配次数
+        size_t misses;      // 去 PageCache 要的次数
+    };
+
+    void* allocate(size_t size);
+    void deallocate(PageCache::Span* span);
+
+    // 大对象改变大小（新大小也 > MAX_BYTES）：先在 PageCache 里原地伸缩，
+    // 不行再换一块，大块用 mremap 把页表搬过去，不逐字节拷贝；失败返回 nullptr，原来的块不动
+    void* reallocate(void* ptr, size_t newSize);
+
+    // 把缓存的span全部还给 PageCache（trim 时用）
+    void flush();
+
+    Stats stats();
+
+private:
+    using Span = PageCache::Span;
+
+    LargeCache() = default;
+
+    static constexpr size_t MIN_PAGES         = MAX_BYTES / PAGE_SIZE + 1;    // 大对象最少页数
+    static constexpr size_t MIN_BUCKET        = 6;                            // log2(MIN_PAGES)
+    static constexpr size_t NUM_BUCKETS       = 8;                            // 65 页 ~ 64MB
+    static constexpr size_t ENTRIES_PER_BUCKET = 8;
+    static constexpr size_t MAX_CACHED_BYTES  = 64 * 1024 * 1024;            // 缓存总量上限
+    static constexpr size_t MAX_CACHED_PAGES  = (size_t(1) << (MIN_BUCKET + NUM_BUCKETS)) - 1;
+    static constexpr size_t MREMAP_MIN_BYTES  = 1024 * 1024;                 // 搬这么多以上用 mremap
+
+    static_assert((size_t(1) << MIN_BUCKET) <= MIN_PAGES && MIN_PAGES < (size_t(1) << (MIN_BUCKET + 1)),
+                  "MIN_BUCKET must be log2(MIN_PAGES)");
+
+    // 按页数的 log2 分桶，每桶一个小数组，最新放进来的在末尾
+    struct Bucket
+    {
+        std::array<Span*, ENTRIES_PER_BUCKET> entries{};
+        size_t count = 0;
+    };
+
+    static size_t bucketOf(size_t numPages)
+    {
+        return detail::log2Floor(numPages) - MIN_BUCKET;
+    }
+
+    // 在 bucket 里找页数落在 [numPages, maxPages] 的最小者并取出
+    Span* take(size_t bucket, size_t numPages, size_t maxPages);
+
+    // 把 src 的 bytes 字节（页对齐）的物理页搬到 dst，src 留下未缺页的空映射；内核不支持时返回 false
+    static bool movePages(void* src, void* dst, size_t bytes);
+
+    SpinLock lock_;
+    std::array<Bucket, NUM_BUCKETS> buckets_{};
+    size_t cachedSpans_ = 0;
+    size_t cachedPages_ = 0;
+    size_t inUseSpans_  = 0;
+    size_t inUsePages_  = 0;
+    size_t hits_        = 0;
+    size_t misses_      = 0;
+};
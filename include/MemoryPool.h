@@ -1,5 +1,12 @@
 #pragma once
 #include "ThreadCache.h"
+#include "PageCache.h"
+#include "LargeCache.h"
+#include "CentralCache.h"
+#include "CpuCache.h"
+#include "HeapProfiler.h"
+#include "PoolStats.h"
+#include <cstdint>
 
 
 class MemoryPool
@@ -7,12 +14,264 @@ class MemoryPool
 public:
     static void* allocate(size_t size)
     {
+        // 堆分析器关着时也只是减一个线程本地计数
+        if (HeapProfiler::shouldSample(size))
+        {
+            if (void* ptr = HeapProfiler::allocate(size)) return ptr;
+        }
+        if (CpuCache::enabled()) return CpuCache::allocate(size);
         return ThreadCache::getInstance()->allocate(size);
     }
 
     static void deallocate(void* ptr, size_t size)
     {
+        // 采样到的小对象不在普通span里，按地址区间认出来
+        if (HeapProfiler::owns(ptr)) return HeapProfiler::deallocate(ptr);
+        if (CpuCache::enabled()) return CpuCache::deallocate(ptr, size);
         ThreadCache::getInstance()->deallocate(ptr, size);
     }
 
+    // 大小编译期已知（比如 sizeof(T)）：size-class 编译期算好，不再判 0 和大对象，只剩本地链的弹出/压入
+    template <size_t Size>
+    static void* allocate()
+    {
+        if constexpr (Size > MAX_BYTES)
+        {
+            return allocate(Size);
+        }
+        else
+        {
+            constexpr size_t index = SizeClass::getIndex(Size);
+            if (HeapProfiler::shouldSample(Size))
+            {
+                if (void* ptr = HeapProfiler::allocate(Size)) return ptr;
+            }
+            if (CpuCache::enabled()) return CpuCache::allocateClass(index);
+            return ThreadCache::getInstance()->allocateClass(index);
+        }
+    }
+
+    template <size_t Size>
+    static void deallocate(void* ptr)
+    {
+        if constexpr (Size > MAX_BYTES)
+        {
+            deallocate(ptr, Size);
+        }
+        else
+        {
+            constexpr size_t index = SizeClass::getIndex(Size);
+            if (HeapProfiler::owns(ptr)) return HeapProfiler::deallocate(ptr);
+            if (CpuCache::enabled()) return CpuCache::deallocateClass(ptr, index);
+            ThreadCache::getInstance()->deallocateClass(ptr, index);
+        }
+    }
+
+    // 批量申请 n 块 size 字节的内存写到 out，返回实际拿到的块数（内存不够时可能少于 n）
+    // 线程缓存整段摘链，不够的部分一次 fetchRange；每 CPU 缓存打开时逐块申请
+    // 整批按 n * size 字节计入堆分析器的采样间隔：间隔落在批里几次就采样几块，采样的块放在最前面
+    static size_t allocateBatch(size_t size, size_t n, void** out)
+    {
+        size_t sampled = 0;
+        size_t left = n; // 还没计入采样间隔的块
+        while (left && left <= SIZE_MAX / std::max<size_t>(size, 1) && HeapProfiler::shouldSample(size * left))
+        {
+            size_t skip = HeapProfiler::blocksBeforeSample(size, left);
+            void* ptr = HeapProfiler::allocate(size);
+            if (!ptr) break;
+            out[sampled++] = ptr;
+            left -= skip + 1;
+        }
+        out += sampled;
+        n -= sampled;
+
+        if (CpuCache::enabled())
+        {
+            for (size_t i = 0; i < n; ++i)
+            {
+                out[i] = CpuCache::allocate(size);
+                if (!out[i]) return sampled + i;
+            }
+            return sampled + n;
+        }
+        return sampled + ThreadCache::getInstance()->allocateBatch(size, n, out);
+    }
+
+    // 批量释放 n 块同样大小（申请时的 size）的内存，ptrs 里不能有 nullptr；放不下本地链的部分一次 returnRange
+    static void deallocateBatch(void** ptrs, size_t n, size_t size)
+    {
+        // 批里混着采样对象时逐块释放
+        if (HeapProfiler::regionMapped() && std::any_of(ptrs, ptrs + n, HeapProfiler::owns))
+        {
+            for (size_t i = 0; i < n; ++i)
+            {
+                deallocate(ptrs[i], size);
+            }
+            return;
+        }
+        if (CpuCache::enabled())
+        {
+            for (size_t i = 0; i < n; ++i)
+            {
+                CpuCache::deallocate(ptrs[i], size);
+            }
+            return;
+        }
+        ThreadCache::getInstance()->deallocateBatch(ptrs, n, size);
+    }
+
+    // 不带大小的释放：通过页表找到所属span，由span记录的 size-class 决定还到哪条自由链表
+    static void deallocate(void* ptr)
+    {
+        if (!ptr) return;
+        if (HeapProfiler::owns(ptr)) return HeapProfiler::deallocate(ptr);
+        if (CpuCache::enabled()) return CpuCache::deallocate(ptr);
+        ThreadCache::getInstance()->deallocate(ptr);
+    }
+
+    // 按 alignment（2 的幂）对齐分配，不加头部：
+    // 一页以内的对齐挑块大小是 alignment 整数倍的 size-class（span 按页对齐，切出的每块都对齐），大对象本身按页对齐；
+    // 超过一页的对齐多要 alignment 字节的大对象，返回span中间对齐的地址，释放时按页表找回span
+    static void* allocateAligned(size_t size, size_t alignment);
+
+    // 对齐分配实际向内存池要的大小（编译期可用）；溢出时返回 0
+    static constexpr size_t alignedSize(size_t size, size_t alignment)
+    {
+        if (alignment <= ALIGNMENT) return size;
+        if (alignment <= PAGE_SIZE)
+        {
+            if (size > MAX_BYTES) return size;
+            // 2 的幂都是 size-class（128B 起每翻一倍就有一档），最多找到 max(size, alignment) 向上取 2 的幂那档
+            size_t index = SizeClass::getIndex(std::max(size, alignment));
+            while (SizeClass::classSize(index) % alignment != 0) ++index;
+            return SizeClass::classSize(index);
+        }
+        if (size > SIZE_MAX - alignment) return 0;
+        return std::max(size + alignment, MAX_BYTES + 1);
+    }
+
+    // 用申请时的 size 和 alignment 释放；也可以直接用不带大小的 deallocate
+    static void deallocateAligned(void* ptr, size_t size, size_t alignment)
+    {
+        if (!ptr) return;
+        deallocate(ptr, alignedSize(size, alignment));
+    }
+
+    // 改变块的大小，内容按两者中较小的保留：
+    // 小块新大小仍落在原来的块里（且不小于块大小的一半）直接返回原指针；大对象先在 PageCache 里原地伸缩，
+    // 搬家时大块用 mremap 挪页表而不拷贝。newSize 为 0 时释放并返回 nullptr；失败返回 nullptr，原来的块不动
+    static void* reallocate(void* ptr, size_t oldSize, size_t newSize);
+
+    // 不带旧大小的版本，旧大小按 usableSize 算；对齐分配的块要用这个版本
+    static void* reallocate(void* ptr, size_t newSize)
+    {
+        return reallocate(ptr, ptr ? usableSize(ptr) : 0, newSize);
+    }
+
+    // 前端改用每 CPU 缓存（rseq）：缓存总量按核数封顶，不随线程数增长
+    // 编译时关闭了 ENABLE_PERCPU_CACHE 或运行环境没有 rseq 时返回 false，继续用线程缓存
+    static bool setPerCpuCache(bool enabled)
+    {
+        return CpuCache::setEnabled(enabled);
+    }
+
+    // 先把 transfer cache 里的批次拆回span、LargeCache 缓存的大对象还给 PageCache，
+    // 再把空闲页还给系统（madvise），只保留 keepBytes 常驻，返回本次释放的字节数
+    static size_t trim(size_t keepBytes = 0)
+    {
+        CentralCache::getInstance().flushTransferCaches();
+        LargeCache::getInstance().flush();
+        return PageCache::getInstance().releaseFreeSpans(0, keepBytes);
+    }
+
+    // 后台回收：定期把闲置够久的空闲页还给系统，默认不开启
+    static void startScavenger(const PageCache::ScavengerOptions& options = {})
+    {
+        PageCache::getInstance().startScavenger(options);
+    }
+
+    static void stopScavenger()
+    {
+        PageCache::getInstance().stopScavenger();
+    }
+
+    // 还给系统的内存统计
+    static PageCache::ReleaseStats releaseStats()
+    {
+        return PageCache::getInstance().releaseStats();
+    }
+
+    // 大页模式开关：之后新向系统申请的内存按 2MB 对齐整块申请并 MADV_HUGEPAGE
+    static void setHugePageMode(bool enabled)
+    {
+        PageCache::getInstance().setHugePageMode(enabled);
+    }
+
+    static PageCache::HugePageStats hugePageStats()
+    {
+        return PageCache::getInstance().hugePageStats();
+    }
+
+    // 所有线程缓存加起来的上限（默认 32MB）
+    static void setThreadCacheLimit(size_t bytes)
+    {
+        ThreadCache::setTotalLimit(bytes);
+    }
+
+    static ThreadCache::BudgetStats threadCacheStats()
+    {
+        return ThreadCache::budgetStats();
+    }
+
+    // 收回闲置超过 idleMs 的线程的缓存额度，返回收回的字节数
+    static size_t shrinkIdleThreadCaches(size_t idleMs)
+    {
+        return ThreadCache::shrinkIdleCaches(idleMs);
+    }
+
+    // 线程缓存每档的未命中/超长次数
+    static ThreadCache::ClassStats classStats(size_t index)
+    {
+        return ThreadCache::classStats(index);
+    }
+
+    // 大对象（> MAX_BYTES）的使用量和缓存命中统计
+    static LargeCache::Stats largeStats()
+    {
+        return LargeCache::getInstance().stats();
+    }
+
+    // 汇总各层的计数：每档分配/释放、各层缓存的字节数、span/页、和系统之间的往来
+    // 读的时候才遍历各线程的计数，代价和线程数成正比，不要放在热路径上；toText()/toJson() 输出
+    static PoolStats stats();
+
+    // 采样堆分析器：平均每分配 sampleBytes 字节采一次样并记下调用栈，默认关闭；采样区映射失败时返回 false
+    static bool startHeapProfiler(size_t sampleBytes = HeapProfiler::DEFAULT_SAMPLE_BYTES)
+    {
+        return HeapProfiler::start(sampleBytes);
+    }
+
+    static void stopHeapProfiler()
+    {
+        HeapProfiler::stop();
+    }
+
+    // pprof 格式的在用堆剖面和累计分配剖面，写到文件里用 pprof <程序> <文件> 查看
+    static std::string heapProfile()
+    {
+        return HeapProfiler::heapProfile();
+    }
+
+    static std::string allocationProfile()
+    {
+        return HeapProfiler::allocationProfile();
+    }
+
+    // 实际可用的字节数（即所在 size-class 的块大小）
+    static size_t usableSize(const void* ptr)
+    {
+        if (HeapProfiler::owns(ptr)) return HeapProfiler::usableSize(ptr);
+        return ThreadCache::usableSize(ptr);
+    }
+
 };
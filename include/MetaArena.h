@@ -0,0 +1,123 @@
+#pragma once
+#include "Common.h"
+#include <sys/mman.h>
+#include <cstring>
+#include <mutex>
+#include <new>
+
+// 内存池自己的元数据分配器：按固定大小切 mmap 来的大块，回收的对象挂在自由链表上复用
+// 元数据（ThreadCache、Span 等）全部从这里拿，内部路径不依赖系统 malloc/new
+// 返回的内存总是清零的；对象只复用、不归还给系统，指向它们的旧指针始终可读
+template <typename T>
+class MetaArena
+{
+public:
+    constexpr MetaArena() = default;
+
+    // 分配一块能放下 T 的清零内存（不调用构造函数）
+    void* allocate()
+    {
+        std::lock_guard<SpinLock> guard(lock_);
+
+        if (freeList_)
+        {
+            void* obj = freeList_;
+            freeList_ = *reinterpret_cast<void**>(obj);
+            std::memset(obj, 0, OBJECT_SIZE);
+            ++inUse_;
+            return obj;
+        }
+
+        if (left_ < OBJECT_SIZE)
+        {
+            // 新 chunk 来自 mmap，本身就是零页，第一次写到哪页才真正占用哪页
+            void* chunk = mmap(nullptr, CHUNK_SIZE, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (chunk == MAP_FAILED) return nullptr;
+            cur_  = static_cast<char*>(chunk);
+            left_ = CHUNK_SIZE;
+            reserved_ += CHUNK_SIZE;
+        }
+
+        void* obj = cur_;
+        cur_  += OBJECT_SIZE;
+        left_ -= OBJECT_SIZE;
+        ++inUse_;
+        return obj;
+    }
+
+    // 回收（不调用析构函数）
+    void deallocate(void* obj)
+    {
+        if (!obj) return;
+        std::lock_guard<SpinLock> guard(lock_);
+        *reinterpret_cast<void**>(obj) = freeList_;
+        freeList_ = obj;
+        --inUse_;
+    }
+
+    size_t inUse() const { return inUse_; }
+    size_t reservedBytes() const { return reserved_; }
+
+private:
+    static constexpr size_t OBJECT_SIZE =
+        (std::max(sizeof(T), sizeof(void*)) + alignof(T) - 1) / alignof(T) * alignof(T);
+    static constexpr size_t CHUNK_SIZE =
+        std::max<size_t>(16 * PAGE_SIZE, (OBJECT_SIZE * 16 + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE);
+
+    SpinLock lock_;
+    void*    freeList_ = nullptr;
+    char*    cur_      = nullptr;
+    size_t   left_     = 0;
+    size_t   inUse_    = 0;
+    size_t   reserved_ = 0;
+};
+
+// 给 PageCache 等内部用的 STL 容器的分配器（std::set 的结点等），同样不走系统 malloc
+// 结点类容器每次只要一个对象，走同类型的 MetaArena；一次要多个的按页直接 mmap
+template <typename T>
+class MetaAllocator
+{
+public:
+    using value_type = T;
+
+    MetaAllocator() = default;
+    template <typename U>
+    MetaAllocator(const MetaAllocator<U>&) {}
+
+    T* allocate(size_t n)
+    {
+        void* mem = nullptr;
+        if (n == 1)
+        {
+            mem = arena_.allocate();
+        }
+        else
+        {
+            mem = mmap(nullptr, bytesFor(n), PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (mem == MAP_FAILED) mem = nullptr;
+        }
+        if (!mem) throw std::bad_alloc{};
+        return static_cast<T*>(mem);
+    }
+
+    void deallocate(T* ptr, size_t n)
+    {
+        if (n == 1) arena_.deallocate(ptr);
+        else munmap(ptr, bytesFor(n));
+    }
+
+    template <typename U>
+    bool operator==(const MetaAllocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const MetaAllocator<U>&) const { return false; }
+
+private:
+    static size_t bytesFor(size_t n)
+    {
+        return (n * sizeof(T) + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+    }
+
+    static inline MetaArena<T> arena_;
+};
@@ -0,0 +1,54 @@
+#pragma once
+#include "MemoryPool.h"
+#include <new>
+#include <utility>
+
+// 定长对象池：T 的 size-class 编译期算好，create/destroy 只剩线程本地链的一次弹出/压入加上构造/析构
+// 所有 ObjectPool<T> 共用内存池，对象可以在一个线程创建、在另一个线程销毁
+// 过对齐的 T（一页以内）落在块大小是对齐整数倍的 size-class 上，同样没有头部
+template <typename T>
+class ObjectPool
+{
+public:
+    static_assert(alignof(T) <= PAGE_SIZE, "ObjectPool supports alignment up to PAGE_SIZE");
+
+    // 实际占用的块大小对应的请求大小
+    static constexpr size_t BLOCK_SIZE = MemoryPool::alignedSize(sizeof(T), alignof(T));
+
+    // 只要内存，不构造
+    static void* allocate()
+    {
+        return MemoryPool::allocate<BLOCK_SIZE>();
+    }
+
+    static void deallocate(void* ptr)
+    {
+        if (ptr) MemoryPool::deallocate<BLOCK_SIZE>(ptr);
+    }
+
+    // 申请并原地构造；构造函数抛异常时把内存还回去再抛出
+    template <typename... Args>
+    static T* create(Args&&... args)
+    {
+        void* mem = allocate();
+        if (!mem) throw std::bad_alloc();
+
+        try
+        {
+            return new (mem) T(std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            deallocate(mem);
+            throw;
+        }
+    }
+
+    // 析构并释放，nullptr 什么也不做
+    static void destroy(T* obj)
+    {
+        if (!obj) return;
+        obj->~T();
+        deallocate(obj);
+    }
+};
@@ -1,9 +1,15 @@
 #pragma once
 #include "Common.h"
+#include "PageMap.h"
+#include "MetaArena.h"
+#include <set>
 #include <map>
 #include <mutex>
 #include <cstdint>
 #include <shared_mutex>
+#include <thread>
+#include <condition_variable>
+#include <new>
 
 class PageCache
 {
@@ -12,38 +18,241 @@ public:
     {
         void*  pageAddr; // 页起始地址
         size_t numPages; // 页数
-        Span*  next;     // 链表指针
+        Span*  next;     // 双向链表指针（PageCache空闲链表 / CentralCache的span链表共用）
+        Span*  prev;
+
+        // 以下字段由 CentralCache 在把span切成小块时设置
+        size_t sizeClass; // 所属 size-class
+        size_t objSize;   // 切出的块大小，0 表示没有被切分
+        size_t useCount;  // 已经交给 ThreadCache 的块数，归零即可整体还给 PageCache
+        void*  freeList;  // 这个span里空闲的块
+
+        bool   isLarge;   // 整个span作为一个大对象交给用户（LargeCache），objSize 为整个span的字节数
+        bool   sampled;   // 大对象被堆分析器采样了，释放时要通知它
+
+        // 所属 arena 编号 + 1，0 表示这个 Span 对象已经回收；span 一辈子属于切出它的那块系统内存所在的 arena
+        // 合并时查到的邻居可能是别的 arena 正在改的旧对象，先比它再碰别的字段
+        std::atomic<uint8_t> arena;
+
+        bool   isFree;    // 是否挂在 PageCache 的空闲链表上
+        bool   released;  // 空闲且物理页已经 madvise 还给了系统
+        uint64_t freeSince; // 变成空闲的时间（毫秒，steady_clock），后台回收按它判断是否闲置够久
+    };
+
+    // 后台回收线程的参数
+    struct ScavengerOptions
+    {
+        size_t intervalMs    = 1000;             // 多久扫一次
+        size_t idleMs        = 5000;             // 空闲超过这么久的span才还给系统
+        size_t headroomBytes = 16 * 1024 * 1024; // 至少保留这么多常驻的空闲内存，应对下一波请求
+        bool   useMadvFree   = false;            // MADV_FREE（惰性回收）还是 MADV_DONTNEED（立即回收）
+    };
+
+    // 还给系统的统计
+    struct ReleaseStats
+    {
+        size_t freeBytes;          // PageCache 里空闲的字节数（含已还给系统的）
+        size_t releasedBytes;      // 其中当前已经 madvise 掉的字节数
+        size_t totalReleasedBytes; // 累计还给系统的字节数
+        size_t releaseCount;       // 累计 madvise 次数
+    };
+
+    // span 和页的统计
+    struct SpanStats
+    {
+        size_t mappedBytes;   // 当前向系统映射着的字节数（含已 madvise 掉的）
+        size_t spansInUse;    // 已分配出去的span（CentralCache 切着的和大对象）
+        size_t pagesInUse;
+        size_t freeSpans;     // 空闲索引里的span（含已还给系统的）
+        size_t freePages;
+        size_t releasedPages; // 其中已经还给系统的页
+    };
+
+    // 大页（THP）统计，按 2MB 一个大页计
+    struct HugePageStats
+    {
+        size_t total;    // 大页模式下保留的 2MB 大页总数
+        size_t full;     // 所有小页都已分配出去
+        size_t partial;  // 部分分配出去
+        size_t free;     // 完全空闲且仍然常驻
+        size_t released; // 整个大页都还给了系统，再用时可以重新按大页缺页
+        size_t broken;   // 只有一部分页被 madvise 还给了系统，内核已把它拆成 4KB 页
     };
 
+    static constexpr size_t HUGE_PAGE_SIZE  = 2 * 1024 * 1024;
+    static constexpr size_t HUGE_PAGE_PAGES = HUGE_PAGE_SIZE / PAGE_SIZE;
+
+    // arena 个数：每个 arena 有自己的锁、空闲索引和向系统申请的区域，线程按轮转分到各个 arena
+    static constexpr size_t NUM_ARENAS = 8;
+
 public:
     static PageCache& getInstance()
     {
+#ifdef MEMORYPOOL_MALLOC_SHIM
+        // 替换了 malloc 时不析构：进程退出途中别的析构函数、别的线程还会来分配和释放
+        alignas(PageCache) static char storage[sizeof(PageCache)];
+        static PageCache* instance = new (storage) PageCache();
+        return *instance;
+#else
         static PageCache instance;
         return instance;
+#endif
+    }
+
+    // 分配指定页数的span：先找本线程的 arena，没有就从别的 arena 借（不等锁），都没有再向系统申请
+    Span* allocateSpan(size_t numPages);
+
+    // 释放span回它所属的 arena，并尝试和前后相邻的空闲span合并
+    void deallocateSpan(Span* span);
+
+    // 原地改变已分配span的页数：缩小时尾部还回空闲索引；变大时吞掉紧挨在后面、够大的空闲span
+    // 做不到（后面不空闲、不够大，或者元数据不够）返回 false，span 不变
+    bool resizeSpan(Span* span, size_t numPages);
+
+    // 找到任意地址所在的span，不是PageCache分配的返回nullptr
+    // 无锁；只保证对“已分配出去的span”里的地址有效
+    Span* mapObjectToSpan(const void* ptr) const
+    {
+        return pageMap_.get(PageMap<Span>::pageIdOf(ptr));
     }
 
-    // 分配指定页数的span
-    void* allocateSpan(size_t numPages);
+    // 已分配出去（不在空闲链表上）的页数
+    size_t pagesInUse() const { return pagesInUse_.load(std::memory_order_relaxed); }
+
+    // 把空闲超过 idleMs 的span还给系统，直到常驻的空闲内存不超过 keepBytes，返回本次释放的字节数
+    size_t releaseFreeSpans(size_t idleMs, size_t keepBytes, bool useMadvFree = false);
 
-    // 释放span
-    void deallocateSpan(void* ptr, size_t numPages);
+    ReleaseStats releaseStats() const;
+    SpanStats spanStats() const;
 
-    //Span* findSpan(void* anyPtr);
+    // 大页模式：向系统按 2MB 对齐的整块申请并 MADV_HUGEPAGE，span 在块内紧密排布；默认关闭
+    void setHugePageMode(bool enabled) { hugePageMode_.store(enabled, std::memory_order_relaxed); }
+    bool hugePageMode() const { return hugePageMode_.load(std::memory_order_relaxed); }
+    HugePageStats hugePageStats();
+
+    // 启停后台回收线程
+    void startScavenger(const ScavengerOptions& options);
+    void stopScavenger();
 
     ~PageCache();              // ← 声明析构
-    void shutdown();           // ← 也提供显式清理接口（见下）
+    void shutdown();           // ← 也提供显式清理接口：把空闲span还给系统
 
 private:
     PageCache() = default;
 
-    // 向系统申请内存
-    void* systemAlloc(size_t numPages);
+    // 空闲span索引：页数小于 MAX_BUCKET_PAGES 的按页数分桶（侵入式双向链表 + 非空桶位图），
+    // 找 >= n 页的最小非空桶只要几次位扫描，摘除任意一个span是 O(1)；
+    // 更大的空闲span很少，放进按 (页数, 地址) 排序的集合里做最佳适配
+    struct FreeIndex
+    {
+        static constexpr size_t MAX_BUCKET_PAGES = 128;
+        static constexpr size_t BITMAP_WORDS = MAX_BUCKET_PAGES / 64;
+
+        struct LargeSpanLess
+        {
+            using is_transparent = void;
+            bool operator()(const Span* a, const Span* b) const
+            {
+                return a->numPages != b->numPages ? a->numPages < b->numPages
+                                                  : a->pageAddr < b->pageAddr;
+            }
+            bool operator()(const Span* a, size_t numPages) const { return a->numPages < numPages; }
+            bool operator()(size_t numPages, const Span* b) const { return numPages < b->numPages; }
+        };
+
+        std::array<Span*, MAX_BUCKET_PAGES> buckets{};
+        std::array<uint64_t, BITMAP_WORDS> bitmap{};
+        std::set<Span*, LargeSpanLess, MetaAllocator<Span*>> large;
+
+        void insert(Span* span);
+        void remove(Span* span);
+        Span* find(size_t numPages) const;
+
+        // 依次取出所有span交给 fn（用于 shutdown）
+        template <typename Fn>
+        void drain(Fn&& fn);
+    };
+
+    // 一个 arena：一把锁管着它的两份空闲索引和大页区域
+    struct Arena
+    {
+        std::mutex mutex;
+
+        // 常驻的空闲span和已经还给系统的空闲span分开索引：分配优先用常驻的，回收只扫常驻的
+        FreeIndex normalSpans;
+        FreeIndex releasedSpans;
+
+        // 大页模式下申请的区域：起始页号 -> 页数
+        std::map<size_t, size_t, std::less<size_t>, MetaAllocator<std::pair<const size_t, size_t>>> hugeRegions;
+    };
+
+    Arena& arenaOf(const Span* span) { return arenas_[span->arena.load(std::memory_order_relaxed) - 1]; }
+
+    // 当前线程的 arena 编号
+    static size_t homeArena();
+
+    // 以下函数都要求持有相应 arena 的锁
+
+    // 在 arena 里找一个够大的空闲span切出 numPages 页交出去
+    Span* allocateFromArena(size_t arenaId, size_t numPages);
+
+    // 把已经从空闲索引里摘下来的span切成 numPages 页，余下的放回空闲索引，登记页表
+    Span* carveSpan(Span* span, size_t numPages);
+
+    // 向系统申请内存；大页模式下会向上取整到 2MB 的整数倍，实际页数写回 numPages
+    void* systemAlloc(Arena& arena, size_t& numPages);
+
+    // 记录一块大页区域（相邻的区域合并成一条）
+    void addHugeRegion(Arena& arena, void* base, size_t numPages);
+
+    // Span 元数据的分配与回收
+    Span* newSpan(size_t arenaId);
+    void deleteSpan(Span* span);
+
+    // 放入/摘出所属 arena 的空闲索引（按是否已还给系统放到不同索引），同时维护页表和计数
+    void insertFreeSpan(Span* span);
+    void removeFreeSpan(Span* span);
+    Span* findFreeSpan(Arena& arena, size_t numPages);
+
+    // 和前后相邻、同一 arena、状态相同（都常驻或都已还给系统）的空闲span合并
+    Span* mergeNeighbors(Span* span);
+
+    // madvise 一个空闲span；大页模式下只还完整的 2MB 大页，头尾不足一个大页的部分切下来继续常驻
+    // 返回实际还掉的字节数
+    size_t releaseSpan(Span* span, bool useMadvFree);
+
+    // 按空闲时间和保留量回收一个 arena 的常驻空闲span
+    size_t releaseArena(Arena& arena, size_t idleMs, size_t keepPages, bool useMadvFree);
+
+    // 在页表里登记空闲span的首尾两页
+    void registerFreeSpan(Span* span);
+
+    static uint64_t nowMs();
+
+    void scavengerLoop(ScavengerOptions options);
+
+    std::array<Arena, NUM_ARENAS> arenas_;
+
+    // 页号到span的映射：已分配的span登记每一页，空闲span只登记首尾两页（合并时用）
+    PageMap<Span> pageMap_;
+
+    // 所有 Span 都从这里切；只复用不归还，页表里残留的旧指针也始终指向合法的 Span
+    MetaArena<Span> spanArena_;
 
-    // 按页数管理空闲span，不同页数对应不同Span链表
-    std::map<size_t, Span*> freeSpans_;
+    std::atomic<bool> hugePageMode_{false};
 
-    // 页起始地址到span的映射，用于回收
-    std::map<void*, Span*> spanMap_;
-    std::mutex mutex_;
+    std::atomic<size_t> mappedBytes_{0};
+    std::atomic<size_t> spansInUse_{0};
+    std::atomic<size_t> freeSpans_{0};
+    std::atomic<size_t> pagesInUse_{0};
+    std::atomic<size_t> normalFreePages_{0};
+    std::atomic<size_t> releasedFreePages_{0};
+    std::atomic<size_t> totalReleasedBytes_{0};
+    std::atomic<size_t> releaseCount_{0};
 
+    // 后台回收线程
+    std::mutex              scavengerMutex_;
+    std::condition_variable scavengerCv_;
+    std::thread             scavenger_;
+    bool                    scavengerStop_ = false;
 };
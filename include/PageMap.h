@@ -0,0 +1,124 @@
+#pragma once
+#include "Common.h"
+#include "MetaArena.h"
+#include <cstdint>
+#include <new>
+
+// 三级基数树页表：页号 -> T*（PageCache 里 T 就是 Span）
+// 48 位地址去掉 12 位页内偏移剩 36 位页号，按 12/12/12 拆成三级，每个节点 4096 项（32KB）
+// 根节点常驻，中间节点和叶子按需从 MetaArena 创建，且永不释放
+// 读：无锁，三次 acquire load；写：同一页只由持有其所属 arena 锁的线程写，不同 arena 可以并发写，
+// 缺的节点用 CAS 挂上去，抢输的一方把自己建的节点放回 MetaArena
+template <typename T>
+class PageMap
+{
+public:
+    static constexpr size_t ADDRESS_BITS = 48;
+    static constexpr size_t PAGE_ID_BITS = ADDRESS_BITS - PAGE_SHIFT;
+    static constexpr size_t LEAF_BITS    = 12;
+    static constexpr size_t MID_BITS     = 12;
+    static constexpr size_t ROOT_BITS    = PAGE_ID_BITS - LEAF_BITS - MID_BITS;
+
+    static size_t pageIdOf(const void* ptr)
+    {
+        return reinterpret_cast<std::uintptr_t>(ptr) >> PAGE_SHIFT;
+    }
+
+    // 无锁查询，没登记过的页返回 nullptr
+    T* get(size_t pageId) const
+    {
+        if (pageId >> PAGE_ID_BITS) return nullptr;
+
+        Mid* mid = root_[rootIndex(pageId)].load(std::memory_order_acquire);
+        if (!mid) return nullptr;
+        Leaf* leaf = mid->leaves[midIndex(pageId)].load(std::memory_order_acquire);
+        if (!leaf) return nullptr;
+        return leaf->values[leafIndex(pageId)].load(std::memory_order_acquire);
+    }
+
+    // 登记 [pageId, pageId + numPages) 都指向 value，需要时创建节点；失败返回 false
+    bool setRange(size_t pageId, size_t numPages, T* value)
+    {
+        for (size_t page = pageId; page < pageId + numPages; )
+        {
+            Leaf* leaf = ensureLeaf(page);
+            if (!leaf) return false;
+
+            // 一个叶子内连续写，不用每页都走一遍上两级
+            size_t leafEnd = std::min(pageId + numPages, (page | (LEAF_LENGTH - 1)) + 1);
+            for (; page < leafEnd; ++page)
+            {
+                leaf->values[leafIndex(page)].store(value, std::memory_order_release);
+            }
+        }
+        return true;
+    }
+
+    bool set(size_t pageId, T* value)
+    {
+        return setRange(pageId, 1, value);
+    }
+
+private:
+    static constexpr size_t LEAF_LENGTH = size_t(1) << LEAF_BITS;
+    static constexpr size_t MID_LENGTH  = size_t(1) << MID_BITS;
+    static constexpr size_t ROOT_LENGTH = size_t(1) << ROOT_BITS;
+
+    struct Leaf
+    {
+        std::atomic<T*> values[LEAF_LENGTH];
+    };
+
+    struct Mid
+    {
+        std::atomic<Leaf*> leaves[MID_LENGTH];
+    };
+
+    static size_t rootIndex(size_t pageId) { return pageId >> (LEAF_BITS + MID_BITS); }
+    static size_t midIndex(size_t pageId)  { return (pageId >> LEAF_BITS) & (MID_LENGTH - 1); }
+    static size_t leafIndex(size_t pageId) { return pageId & (LEAF_LENGTH - 1); }
+
+    Leaf* ensureLeaf(size_t pageId)
+    {
+        if (pageId >> PAGE_ID_BITS) return nullptr;
+
+        Mid* mid = root_[rootIndex(pageId)].load(std::memory_order_acquire);
+        if (!mid)
+        {
+            void* mem = midArena_.allocate();
+            if (!mem) return nullptr;
+            Mid* fresh = new (mem) Mid();
+            // release：读者看到指针时，节点内容（全零）一定已经可见
+            if (root_[rootIndex(pageId)].compare_exchange_strong(mid, fresh, std::memory_order_acq_rel))
+            {
+                mid = fresh;
+            }
+            else
+            {
+                midArena_.deallocate(fresh);
+            }
+        }
+
+        Leaf* leaf = mid->leaves[midIndex(pageId)].load(std::memory_order_acquire);
+        if (!leaf)
+        {
+            void* mem = leafArena_.allocate();
+            if (!mem) return nullptr;
+            Leaf* fresh = new (mem) Leaf();
+            if (mid->leaves[midIndex(pageId)].compare_exchange_strong(leaf, fresh, std::memory_order_acq_rel))
+            {
+                leaf = fresh;
+            }
+            else
+            {
+                leafArena_.deallocate(fresh);
+            }
+        }
+        return leaf;
+    }
+
+    std::atomic<Mid*> root_[ROOT_LENGTH] = {};
+
+    static inline MetaArena<Mid>  midArena_;
+    static inline MetaArena<Leaf> leafArena_;
+};
@@ -0,0 +1,88 @@
+#pragma once
+#include "MemoryPool.h"
+#include <cstddef>
+#include <limits>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+
+// STL 分配器：容器换一个模板参数就走内存池，比如 std::map<K, V, std::less<K>, PoolAllocator<std::pair<const K, V>>>
+// 容器释放时会把当初申请的个数传回来，按大小释放，不需要头部也不用查页表
+// 没有状态，所有 PoolAllocator 都相等，容器之间可以随意交换/移动结点
+template <typename T>
+class PoolAllocator
+{
+public:
+    using value_type = T;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using propagate_on_container_move_assignment = std::true_type;
+    using is_always_equal = std::true_type;
+
+    PoolAllocator() noexcept = default;
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>&) noexcept {}
+
+    T* allocate(size_type n)
+    {
+        if (n > std::numeric_limits<size_type>::max() / sizeof(T))
+        {
+            throw std::bad_array_new_length();
+        }
+
+        void* ptr = OVER_ALIGNED ? MemoryPool::allocateAligned(n * sizeof(T), alignof(T))
+                                 : MemoryPool::allocate(n * sizeof(T));
+        if (!ptr) throw std::bad_alloc();
+        return static_cast<T*>(ptr);
+    }
+
+    void deallocate(T* ptr, size_type n) noexcept
+    {
+        if (OVER_ALIGNED) MemoryPool::deallocateAligned(ptr, n * sizeof(T), alignof(T));
+        else MemoryPool::deallocate(ptr, n * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U>&) const noexcept { return true; }
+
+    template <typename U>
+    bool operator!=(const PoolAllocator<U>&) const noexcept { return false; }
+
+private:
+    static constexpr bool OVER_ALIGNED = alignof(T) > ALIGNMENT;
+};
+
+// std::pmr 的内存资源：std::pmr 容器（或者 monotonic/unsynchronized_pool_resource 的上游）接到内存池上
+// 用 PoolMemoryResource::getInstance() 取全局唯一的实例
+class PoolMemoryResource : public std::pmr::memory_resource
+{
+public:
+    static PoolMemoryResource* getInstance()
+    {
+        static PoolMemoryResource instance;
+        return &instance;
+    }
+
+protected:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        void* ptr = MemoryPool::allocateAligned(bytes, alignment);
+        if (!ptr) throw std::bad_alloc();
+        return ptr;
+    }
+
+    void do_deallocate(void* ptr, std::size_t bytes, std::size_t alignment) override
+    {
+        MemoryPool::deallocateAligned(ptr, bytes, alignment);
+    }
+
+    // 所有实例背后都是同一个内存池，一个释放另一个分配的也没问题
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return dynamic_cast<const PoolMemoryResource*>(&other) != nullptr;
+    }
+
+private:
+    PoolMemoryResource() = default;
+};
@@ -0,0 +1,55 @@
+#pragma once
+#include "Common.h"
+#include <array>
+#include <string>
+
+// 内存池的统计快照，由 MemoryPool::stats() 读的时候从各层汇总：
+// 线程缓存的分配/释放次数记在各线程自己的自由链表上，别的计数都只在慢路径上更新，快路径不碰共享的缓存行
+// 别的线程还在分配释放时，各项之间不保证严格一致
+struct PoolStats
+{
+    struct SizeClassStats
+    {
+        size_t size;              // 块大小
+        size_t allocs;            // 线程缓存前端的分配次数（每 CPU 缓存前端不逐块计数）
+        size_t frees;             // 线程缓存前端的释放次数
+        size_t refills;           // 前端（线程缓存或每 CPU 缓存）向中心缓存取一批的次数
+        size_t spills;            // 前端还一批给中心缓存的次数
+        size_t threadCacheBlocks; // 各线程本地链上缓存着的块
+        size_t transferBlocks;    // transfer cache 里的块
+        size_t centralFreeBlocks; // 中心缓存的span里还没交出去的块
+        size_t spans;             // 中心缓存切着的span数
+    };
+    std::array<SizeClassStats, FREE_LIST_SIZE> classes;
+
+    // 各层缓存着、没在用户手里的字节数
+    size_t threadCacheBytes;
+    size_t cpuCacheBytes;      // 近似值
+    size_t transferCacheBytes;
+    size_t centralCacheBytes;  // 中心缓存的span里的空闲块
+    size_t pageHeapFreeBytes;  // PageCache 空闲索引里还常驻的
+    size_t pageHeapReleasedBytes; // PageCache 空闲索引里已经 madvise 还给系统的
+    size_t largeCacheBytes;    // LargeCache 里等待复用的大对象
+
+    // 大对象
+    size_t largeInUseBytes;
+    size_t largeAllocs;        // 大对象分配次数（缓存命中 + 向 PageCache 要）
+    size_t largeCacheHits;
+
+    // span 和页
+    size_t spansInUse;
+    size_t pagesInUse;
+    size_t freeSpans;
+    size_t freePages;
+
+    // 和系统之间
+    size_t mappedBytes;        // 当前向系统映射着的字节数
+    size_t totalReleasedBytes; // 累计 madvise/munmap 还给系统的字节数
+    size_t releaseCount;
+
+    // 人看的文本；只列出有过分配的 size-class
+    std::string toText() const;
+
+    // 给监控采集的 JSON，一个对象
+    std::string toJson() const;
+};
@@ -0,0 +1,21 @@
+#pragma once
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <string>
+
+// 统计和堆剖面这些文本输出共用，库内部的 .cpp 用
+namespace detail
+{
+    // 格式化追加到 out 后面；一行输出不会超过缓冲区，超长的截断
+    __attribute__((format(printf, 2, 3)))
+    inline void appendf(std::string& out, const char* fmt, ...)
+    {
+        char buf[256];
+        va_list args;
+        va_start(args, fmt);
+        int n = std::vsnprintf(buf, sizeof(buf), fmt, args);
+        va_end(args);
+        if (n > 0) out.append(buf, std::min(static_cast<size_t>(n), sizeof(buf) - 1));
+    }
+}
@@ -1,42 +1,216 @@
 #pragma once
 #include "Common.h"
+#include <cstdint>
 
 // 线程本地缓存,这是一个单例类
 class ThreadCache
 {
 public:
+    // 线程本地只存一个指针，ThreadCache 本体第一次分配时才从元数据区创建
     static ThreadCache* getInstance()
     {
-        static thread_local ThreadCache instance;
-        return &instance;
+        ThreadCache* cache = tlsCache_;
+        if (cache) return cache;
+        return createInstance();
     }
 
     //主要的两个接口，分配内存和释放内存
     void* allocate(size_t size);
     void deallocate(void* ptr, size_t size);
 
+    // 不带大小的释放，按span记录的 size-class 归还
+    void deallocate(void* ptr);
+
+    // 批量申请/释放同样大小的 n 块：本地链上整段摘下/挂上，不够或放不下的部分和中心缓存一次性交接
+    // allocateBatch 返回实际拿到的块数（内存不够时可能少于 n）
+    size_t allocateBatch(size_t size, size_t n, void** out);
+    void deallocateBatch(void** ptrs, size_t n, size_t size);
+
+    // 调用方已经知道 size-class（编译期算好）时的快路径：只剩本地链的弹出/压入，内联到调用方
+    void* allocateClass(size_t index)
+    {
+        FreeList& list = freeList_[index];
+        void* ptr = list.head;
+        if (!ptr) return fetchFromCentralCache(index);
+
+        // 头指向第二个内存块（分配次数不在这里记，读统计时由 fetched - returned - length + frees 推出来）
+        list.head = *reinterpret_cast<void**>(ptr);
+        --list.length;
+        return ptr;
+    }
+
+    void deallocateClass(void* ptr, size_t index)
+    {
+        freeToLocal(index, ptr);
+    }
+
+    // ptr 所在块的实际大小
+    static size_t usableSize(const void* ptr);
+
+    // 每档统计，所有线程（含已经退出的）累计：
+    // 分配/释放次数记在各线程自己的自由链表上，读的时候遍历登记的 ThreadCache 汇总，快路径上不碰共享的缓存行
+    // 别的线程正在分配释放时读到的是近似值
+    struct ClassStats
+    {
+        size_t misses;       // 未命中，向中心缓存取一批
+        size_t overflows;    // 超长，还一批给中心缓存
+        size_t allocs;       // 分配次数
+        size_t frees;        // 释放次数
+        size_t cachedBlocks; // 各线程本地链上现在缓存着的块数
+    };
+    static ClassStats classStats(size_t index);
+    static std::array<ClassStats, FREE_LIST_SIZE> allClassStats();
+
+    // 所有线程缓存共享一个总预算，按各条本地链的上限（maxLength * 块大小）之和计：
+    // 本地链的长度不会超过上限（收紧上限后最多暂时多出一块），上限之和就管住了实际缓存的字节数；
+    // 上限只在慢路径上变，超了额度就把各档上限减半、多出的块还掉，再从公共池或者别的线程（优先闲置的）要一份；
+    // 快路径上不用记账。闲置线程的额度可以被收回
+    //
+    // 额度被收回的线程要等自己下一次走到释放或慢路径才真的把块还掉，在那之前它的上限之和照样占着总预算，
+    // 公共池里只有总上限减去各线程 max(额度, 上限之和) 之后剩下的：
+    // 所以各线程实际缓存的字节数之和不超过总上限，除非线程多到每个线程的最低额度加起来就超了（最低额度照给）
+    struct BudgetStats
+    {
+        size_t limit;       // 总上限
+        size_t claimed;     // 已经分给各线程的额度
+        size_t unclaimed;   // 公共池里剩的额度
+        size_t capacityBytes; // 各线程本地链上限之和
+        size_t cachedBytes; // 各线程本地链上实际缓存的字节数（length * 块大小），读的时候现数
+        size_t caches;      // 登记的 ThreadCache 个数（含暂存的）
+    };
+    static BudgetStats budgetStats();
+    static void setTotalLimit(size_t bytes);
+
+    // 把超过 idleMs 没走过慢路径的线程额度降到最低额度，返回降掉的字节数
+    // 别的线程不能碰它的本地链，只给它打个标记：那个线程下一次释放或走慢路径时把超出额度的块还给中心缓存，
+    // 还掉以后这部分额度才回到公共池；一直闲着不再分配释放的线程，缓存的块一直占着预算，不会被别人用掉
+    static size_t shrinkIdleCaches(size_t idleMs);
+
+    // 线程退出时最多暂存多少个“热”的 ThreadCache 给后来的新线程直接接手，0 表示关闭（默认）
+    static void setMaxParkedCaches(size_t maxParked);
+
 private:
     //单例类，构造私有化
-    ThreadCache();
+    ThreadCache() {}
+
+    // 每个线程第一次使用时创建自己的 ThreadCache，并登记线程退出回调
+    static ThreadCache* createInstance();
+
+    // 线程退出时回调（pthread key 析构）：暂存或清空后回收
+    static void destroyInstance(void* cache);
+
+    // 把所有自由链表整条还给中心缓存，每个 size-class 一次 returnRange
+    void releaseAll();
+
+    // 清空、注销并回收一个 ThreadCache
+    static void retire(ThreadCache* cache);
+
+    // 预算登记：加入/退出全局链表，领取/交回额度
+    void registerCache();
+    void unregisterCache();
+
+    // 把这个线程某一档的计数累加到 stats 上
+    void addClassStats(size_t index, ClassStats& stats) const;
+
+    // 改一档的上限，同时更新 capacity_
+    void setMaxLength(size_t index, size_t maxLength);
+
+    // 超额度：各档上限减半、还掉多出的块，再尝试扩大自己的额度
+    void checkBudget()
+    {
+        if (capacity_.load(std::memory_order_relaxed) > maxSize_.load(std::memory_order_relaxed)) scavenge();
+    }
+    void scavenge();
+    void increaseBudget();
+
+    // 只收缩：各档上限减半、还掉多出的块，直到回到额度以内（暂存起来的缓存不再要额度）
+    void shrinkToBudget();
+
+    // 这个线程占着的总预算：额度被收回后、自己还没收缩之前，按上限之和算
+    size_t chargedBytes() const
+    {
+        return std::max(maxSize_.load(std::memory_order_relaxed), capacity_.load(std::memory_order_relaxed));
+    }
+
+    // 公共池 = 总上限 - 各线程占着的，调用方拿着 registryLock
+    static void refreshUnclaimed();
 
     // 从中心缓存获取内存
     void* fetchFromCentralCache(size_t index);
 
-    // 归还内存到中心缓存
-    void returnToCentralCache(void* start, size_t index);
+    // 从链表头摘 num 块还给中心缓存
+    void returnToCentralCache(size_t index, size_t num);
 
-    // 计算批量获取内存块的数量
-    size_t getBatchNum(size_t size);
+    // 本地链上限能放宽到多少块
+    static size_t maxLengthLimit(size_t index);
 
-    // 判断是否需要归还内存给中心缓存
-    bool shouldReturnToCentralCache(size_t index);
+    // 本地链超过上限：慢启动期放宽上限，否则还一批，反复超长就收紧上限
+    void listTooLong(size_t index);
 
-    void freeToLocal(size_t index, void* ptr);
+    void freeToLocal(size_t index, void* ptr)
+    {
+        FreeList& list = freeList_[index];
+        if (!list.head) list.tail = ptr;
+        *reinterpret_cast<void**>(ptr) = list.head;
+        list.head = ptr;
+        ++list.length;
+        ++list.frees;
+
+        if (list.length > list.maxLength)
+        {
+            listTooLong(index);
+        }
+        else if (shrinkRequested_.load(std::memory_order_relaxed))
+        {
+            // 额度被别的线程收走了，把多出来的块还掉
+            shrinkRequested_.store(false, std::memory_order_relaxed);
+            checkBudget();
+        }
+    }
 
 private:
-    // 每个线程的自由链表数组，一个静态数组，每个位置记录着链表的开头
-    std::array<void*, FREE_LIST_SIZE> freeList_;
+    // 每个 size-class 一条自由链表，连同这一档的计数正好占一条缓存行
+    // 计数只有本线程写，读统计的线程用 relaxed 原子读
+    struct alignas(64) FreeList
+    {
+        void*  head;   // 链表头
+        void*  tail;      // 链表尾，整条还给中心缓存时不用再走一遍（链表为空时无意义）
+        size_t length;    // 链表下面挂了多少个可用内存块
+        size_t maxLength; // 慢启动上限：从 0 开始，未命中时放宽，超长多次后收紧
+        size_t overages;  // 上限收紧前累计的超长次数
+        size_t frees;     // 释放到本地链的块数
+        size_t fetched;   // 从中心缓存取来的块数
+        size_t returned;  // 还给中心缓存的块数
+    };
+
+    static constexpr size_t MAX_LIST_BYTES  = 256 * 1024; // 一条本地链最多缓存的字节数
+    static constexpr size_t MAX_LIST_LENGTH = 8192;       // 一条本地链最多缓存的块数
+    static constexpr size_t MAX_OVERAGES    = 3;          // 超长这么多次后收紧一批
+
+    static constexpr size_t MIN_CACHE_BYTES = 64 * 1024;       // 每个线程的最低额度
+    static constexpr size_t MAX_CACHE_BYTES = 4 * 1024 * 1024; // 每个线程的最高额度
+    static constexpr size_t STEAL_BYTES     = 64 * 1024;       // 每次扩容/偷取的额度
+    static constexpr uint64_t IDLE_STEAL_MS = 1000;            // 这么久没走慢路径算闲置，优先被偷
+
+    // 每个线程的自由链表数组，96 档 * 64B，6KB
+    // 不在构造函数里初始化：内存来自 MetaArena，拿到时已经清零，哪档用到才会写哪档
+    std::array<FreeList, FREE_LIST_SIZE> freeList_;
+
+    // 暂存链表指针（仅在被暂存时使用）
+    ThreadCache* nextParked_;
+
+    // 预算：各档上限折算的字节数（只有本线程写）和允许的额度（可能被别的线程调小）
+    std::atomic<size_t>   capacity_;
+    std::atomic<size_t>   maxSize_;
+    std::atomic<uint64_t> lastActive_; // 最近一次走慢路径的时间（毫秒）
+    std::atomic<bool>     shrinkRequested_; // 额度被收回或偷走，下次释放时检查
+    ThreadCache* regNext_;
+    ThreadCache* regPrev_;
+
+    // 所有线程累计的每档计数，只在慢路径上更新
+    static inline std::array<std::atomic<size_t>, FREE_LIST_SIZE> misses_{};
+    static inline std::array<std::atomic<size_t>, FREE_LIST_SIZE> overflows_{};
 
-    // 自由链表大小统计，每个位置的值表示该位置链表下面挂了多少个可用内存块
-    std::array<size_t, FREE_LIST_SIZE> freeListSize_;
+    // 当前线程的 ThreadCache，TLS 里只有这 8 字节
+    static inline thread_local ThreadCache* tlsCache_ = nullptr;
 };
@@ -8,29 +8,9 @@
 #include <cstdint>
 #include "MemoryPool.h"
 
-// 可选：开发/CI 打开校验，Release 关闭即可免分支
-// #define MP_DEBUG_GUARD 1
-
-// 16B 对齐的最小头部：记录 class 索引 + 回退偏移 + 用户原始大小
-// sizeof == 16，align == 16，保证 (hdr+1) 也保持 16B 对齐
-struct alignas(16) MpHeader {
-    std::uint16_t size_class;    // 小对象释放 O(1)
-    std::uint8_t  back;          // base→hdr 的对齐回退偏移（字节，<16）
-    std::uint8_t  flags;         // bit0: LARGE（>MAX_BYTES 的直通大对象）
-#ifdef MP_DEBUG_GUARD
-    std::uint32_t magic;         // 调试校验
-#else
-    std::uint32_t pad;           // 填充保持 16B 头部
-#endif
-    std::uint64_t user_size;     // 仅大对象路径使用；小对象不依赖它
-};
-static_assert(sizeof(MpHeader) == 16, "MpHeader must be 16 bytes");
-
-#ifdef MP_DEBUG_GUARD
-static constexpr std::uint32_t kMpMagic = 0xC0FFEEu;
-#endif
-
 // 单例分配器外壳（保持你原来的接口）
+// 不再在每块内存前面放头部：释放时由内存池通过页表查到所属span和 size-class
+// 块本身按 size-class 切分，起始地址天然 16B 对齐
 class CMemory {
 private:
     CMemory() = default;
@@ -46,7 +26,13 @@ public:
     }
 
     void* AllocMemory(int memCount, bool ifmemset);
+
+    // 按 alignment（2 的幂）对齐，同样没有头部，用 FreeMemory 释放
+    void* AllocAlignedMemory(int memCount, std::size_t alignment, bool ifmemset);
     void  FreeMemory(void* point);
+
+    // 改变大小，原来的内容保留；能原地伸缩就返回原指针
+    void* ReallocMemory(void* point, int memCount);
 };
 
 #endif // TXKJ_MYMEMORY_H
@@ -2,173 +2,286 @@
 #include "PageCache.h"
 #include <cassert>
 #include <thread>
+#include <algorithm>
 
-void* CentralCache::fetchRange(size_t index, size_t batchNum)
+size_t CentralCache::fetchRange(size_t index, size_t batchNum, void*& start, void*& end)
 {
     // 索引检查，当索引大于等于FREE_LIST_SIZE时，说明申请内存过大应直接向系统申请
     if (index >= FREE_LIST_SIZE || batchNum == 0) 
-        return nullptr;
+        return 0;
 
-    // 自旋锁保护
-    while (locks_[index].test_and_set(std::memory_order_acquire))
+    // 先看 transfer cache 里有没有别的线程刚还回来的整批
+    TransferCache& tc = transfer_[index];
+    uint32_t slot = popSlot(tc, tc.full);
+    if (slot != NO_SLOT)
     {
-        std::this_thread::yield(); // 添加线程让步，避免忙等待，避免过度消耗CPU
-    }
+        Batch& batch = tc.slots[slot];
+        start = batch.head;
+        end   = batch.tail;
+        size_t count = batch.count;
+        tc.blocks.fetch_sub(count, std::memory_order_relaxed);
+        pushSlot(tc, tc.empty, slot);
 
-    //拿到了锁
-    void* result = nullptr;
-    try 
-    {
-        // 尝试从中心缓存获取内存块
-        result = centralFreeList_[index].load(std::memory_order_acquire);
-
-        if (!result)
+        // 批次比要的多（慢启动期一次只要几块）：只交出 batchNum 块，多出来的拆回span
+        if (count > batchNum)
         {
-            // 如果中心缓存为空，从页缓存获取新的内存块
-            size_t size = (index + 1) * ALIGNMENT;
-            result = fetchFromPageCache(size);
-
-            if (!result)
+            end = start;
+            for (size_t i = 1; i < batchNum; ++i)
             {
-                //释放锁
-                locks_[index].clear(std::memory_order_release);
-                return nullptr;
+                end = *reinterpret_cast<void**>(end);
             }
+            void* rest = *reinterpret_cast<void**>(end);
+            *reinterpret_cast<void**>(end) = nullptr;
+            returnToSpans(rest, count - batchNum, index);
+            count = batchNum;
+        }
+        return count;
+    }
 
-            size_t numPages = (size <= SPAN_PAGES * PAGE_SIZE)
-                ? SPAN_PAGES
-                : ( (size + PAGE_SIZE - 1) / PAGE_SIZE );
-
-            // 将从PageCache获取的内存块切分成小块
-            char* start = static_cast<char*>(result);
-            size_t totalBlocks = (numPages * PAGE_SIZE) / size;
-
-            //分配小的，那多余部分咋办
-            size_t allocBlocks = std::min(batchNum, totalBlocks);
+    return fetchFromSpans(index, batchNum, start, end);
+}
 
-            if (allocBlocks == 1) {
-                *reinterpret_cast<void**>(start) = nullptr;
-            }
+size_t CentralCache::fetchFromSpans(size_t index, size_t batchNum, void*& start, void*& end)
+{
+    // 自旋锁保护
+    std::lock_guard<SpinLock> lock(locks_[index]);
 
-            // 构建返回给ThreadCache的内存块链表
-            if (allocBlocks > 1) 
-            {  
-                // 确保至少有两个块才构建链表
-                // 构建链表
-                for (size_t i = 1; i < allocBlocks; ++i) 
-                {
-                    void* current = start + (i - 1) * size;
-                    void* next = start + i * size;
-                    *reinterpret_cast<void**>(current) = next;
-                }
-                //最后一个结点指向空
-                *reinterpret_cast<void**>(start + (allocBlocks - 1) * size) = nullptr;
-            }
+    // 从还有空闲块的span里摘块，串成链表交给ThreadCache
+    void* head = nullptr;
+    void* tail = nullptr;
+    size_t count = 0;
 
-            // 构建保留在CentralCache的链表，这里处理多余部分
-            if (totalBlocks > allocBlocks)
-            {
-                void* remainStart = start + allocBlocks * size;
-                //把多余的结点也串起来
-                for (size_t i = allocBlocks + 1; i < totalBlocks; ++i)
-                {
-                    void* current = start + (i - 1) * size;
-                    void* next = start + i * size;
-                    *reinterpret_cast<void**>(current) = next;
-                }
-                *reinterpret_cast<void**>(start + (totalBlocks - 1) * size) = nullptr;
-
-                //多余的挂在中心缓存里
-                centralFreeList_[index].store(remainStart, std::memory_order_release);
-            }
-        } 
-        else // 如果中心缓存有index对应大小的内存块
+    while (count < batchNum)
+    {
+        Span* span = spanLists_[index];
+        if (!span)
         {
-            // 从现有链表中获取指定数量的块
-            void* current = result;
-            void* prev = nullptr;
-            size_t count = 0;
+            // 所有span都被掏空了，向页缓存要一个新的
+            span = fetchFromPageCache(index);
+            if (!span) break;
+            pushSpan(index, span);
+            ++spanCounts_[index];
+        }
 
-            while (current && count < batchNum)
-            {
-                prev = current;
-                current = *reinterpret_cast<void**>(current);
-                count++;
-            }
+        // 从这个span里尽量多拿
+        while (span->freeList && count < batchNum)
+        {
+            void* obj = span->freeList;
+            span->freeList = *reinterpret_cast<void**>(obj);
+            ++span->useCount;
 
-            //问题又来了，多余的咋办
-            if (prev) // 当前centralFreeList_[index]链表上的内存块大于batchNum时需要用到 
-            {
-                *reinterpret_cast<void**>(prev) = nullptr;
-            }
+            if (tail) *reinterpret_cast<void**>(tail) = obj;
+            else head = obj;
+            tail = obj;
+            ++count;
+        }
 
-            centralFreeList_[index].store(current, std::memory_order_release);
+        // span已经没有空闲块了，先从链表上摘下来，等有块还回来再挂上
+        if (!span->freeList)
+        {
+            unlinkSpan(index, span);
         }
     }
-    catch (...) 
-    {
-        locks_[index].clear(std::memory_order_release);
-        throw;
-    }
 
-    // 释放锁
-    locks_[index].clear(std::memory_order_release);
-    return result;
+    //最后一个结点指向空
+    if (tail) *reinterpret_cast<void**>(tail) = nullptr;
+    start = head;
+    end   = tail;
+    return count;
 }
 
 
 
-void* CentralCache::fetchFromPageCache(size_t size)
+PageCache::Span* CentralCache::fetchFromPageCache(size_t index)
 {
-    // 1. 计算实际需要的页数，size最小是8，8-4k都是分配一页，以此类推
-    size_t numPages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+    // 页数由 size-class 表预先算好：小块至少 SPAN_PAGES 页，并保证切块后尾部浪费不超过 1/8
+    size_t size = SizeClass::classSize(index);
+    Span* span = PageCache::getInstance().allocateSpan(SizeClass::classPages(index));
+    if (!span) return nullptr;
 
-    // 2. 根据大小决定分配策略
-    if (size <= SPAN_PAGES * PAGE_SIZE)
+    // 将从PageCache获取的内存块切分成小块，串在span自己的空闲链表上
+    char* start = static_cast<char*>(span->pageAddr);
+    size_t totalBlocks = (span->numPages * PAGE_SIZE) / size;
+    for (size_t i = 1; i < totalBlocks; ++i)
     {
-        // 小于等于32KB的请求，使用固定8页
-        return PageCache::getInstance().allocateSpan(SPAN_PAGES);
-    }
-    else
-    {
-        // 大于32KB的请求，按实际需求分配
-        return PageCache::getInstance().allocateSpan(numPages);
+        *reinterpret_cast<void**>(start + (i - 1) * size) = start + i * size;
     }
+    *reinterpret_cast<void**>(start + (totalBlocks - 1) * size) = nullptr;
+
+    span->sizeClass = index;
+    span->objSize   = size;
+    span->useCount  = 0;
+    span->freeList  = start;
+    span->prev      = nullptr;
+    span->next      = nullptr;
+    return span;
 }
 
 
 
-void CentralCache::returnRange(void* start, size_t returnNum, size_t index)
+void CentralCache::returnRange(void* start, void* end, size_t count, size_t index)
 {
     // 当索引大于等于FREE_LIST_SIZE时，说明内存过大应直接向系统归还
-    if (!start || index >= FREE_LIST_SIZE) 
+    if (!start || count == 0 || index >= FREE_LIST_SIZE) 
         return;
 
-    while (locks_[index].test_and_set(std::memory_order_acquire)) 
+    // 按这一档的批大小切开放进 transfer cache，一批最多 classBatch 块，取的一方不会一下拿走一整条；
+    // 放不下的部分逐块拆回span
+    TransferCache& tc = transfer_[index];
+    const size_t batchNum  = SizeClass::classBatch(index);
+    const size_t maxBlocks = std::max(TRANSFER_BYTES / SizeClass::classSize(index), batchNum);
+    while (count)
     {
-        std::this_thread::yield();
+        size_t n = std::min(count, batchNum);
+        if (tc.blocks.load(std::memory_order_relaxed) + n > maxBlocks) break;
+        uint32_t slot = popSlot(tc, tc.empty);
+        if (slot == NO_SLOT) break;
+
+        // 这一批的尾：整条还回来的最后一段首尾已知，前面的要沿链表数 n 块
+        void* tail = end;
+        if (n < count)
+        {
+            tail = start;
+            for (size_t i = 1; i < n; ++i)
+            {
+                tail = *reinterpret_cast<void**>(tail);
+            }
+        }
+        void* next = *reinterpret_cast<void**>(tail);
+        *reinterpret_cast<void**>(tail) = nullptr;
+
+        Batch& batch = tc.slots[slot];
+        batch.head  = start;
+        batch.tail  = tail;
+        batch.count = n;
+        tc.blocks.fetch_add(n, std::memory_order_relaxed);
+        pushSlot(tc, tc.full, slot);
+
+        start = next;
+        count -= n;
     }
 
-    try 
+    if (count) returnToSpans(start, count, index);
+}
+
+void CentralCache::flushTransferCaches()
+{
+    for (size_t index = 0; index < FREE_LIST_SIZE; ++index)
     {
-        // 找到要归还的链表的最后一个节点
-        void* end = start;
-        size_t count = 1;
-        while (*reinterpret_cast<void**>(end) != nullptr && count < returnNum) {
-            end = *reinterpret_cast<void**>(end);
-            count++;
+        TransferCache& tc = transfer_[index];
+        uint32_t slot;
+        while ((slot = popSlot(tc, tc.full)) != NO_SLOT)
+        {
+            Batch& batch = tc.slots[slot];
+            void* head = batch.head;
+            size_t count = batch.count;
+            tc.blocks.fetch_sub(count, std::memory_order_relaxed);
+            pushSlot(tc, tc.empty, slot);
+            returnToSpans(head, count, index);
         }
+    }
+}
+
+CentralCache::ClassStats CentralCache::classStats(size_t index)
+{
+    ClassStats stats{};
+    if (index >= FREE_LIST_SIZE) return stats;
+    stats.transferBlocks = transfer_[index].blocks.load(std::memory_order_relaxed);
 
-        // 将归还的链表连接到中心缓存的链表头部
-        void* current = centralFreeList_[index].load(std::memory_order_acquire);
-        *reinterpret_cast<void**>(end) = current;  // 将原链表头接到归还链表的尾部
-        centralFreeList_[index].store(start, std::memory_order_release);  // 将归还的链表头设为新的链表头
+    // 链表上只有还有空闲块的span，被掏空的span不用数
+    std::lock_guard<SpinLock> lock(locks_[index]);
+    stats.spans = spanCounts_[index];
+    for (Span* span = spanLists_[index]; span; span = span->next)
+    {
+        stats.freeBlocks += span->numPages * PAGE_SIZE / span->objSize - span->useCount;
     }
-    catch (...) 
+    return stats;
+}
+
+uint32_t CentralCache::popSlot(TransferCache& tc, std::atomic<uint64_t>& top)
+{
+    uint64_t old = top.load(std::memory_order_acquire);
+    while (true)
+    {
+        uint32_t id = static_cast<uint32_t>(old);
+        if (id == 0) return NO_SLOT;
+
+        // 读到的 next 可能已经过时（这个槽被别人弹出又压回），那样版本号一定变了，CAS 会失败重来
+        uint32_t next = tc.slots[id - 1].next.load(std::memory_order_relaxed);
+        uint64_t desired = (((old >> 32) + 1) << 32) | next;
+        if (top.compare_exchange_weak(old, desired, std::memory_order_acquire, std::memory_order_acquire))
+        {
+            return id - 1;
+        }
+    }
+}
+
+void CentralCache::pushSlot(TransferCache& tc, std::atomic<uint64_t>& top, uint32_t slot)
+{
+    // release：槽里写好的批次对弹出它的线程可见
+    uint64_t old = top.load(std::memory_order_relaxed);
+    uint64_t desired;
+    do
+    {
+        tc.slots[slot].next.store(static_cast<uint32_t>(old), std::memory_order_relaxed);
+        desired = (((old >> 32) + 1) << 32) | (slot + 1);
+    } while (!top.compare_exchange_weak(old, desired, std::memory_order_release, std::memory_order_relaxed));
+}
+
+void CentralCache::returnToSpans(void* start, size_t returnNum, size_t index)
+{
+    std::lock_guard<SpinLock> lock(locks_[index]);
+
+    // 逐块还回所属的span
+    void* current = start;
+    size_t count = 0;
+    while (current && count < returnNum)
     {
-        locks_[index].clear(std::memory_order_release);
-        throw;
+        void* next = *reinterpret_cast<void**>(current);
+        ++count;
+
+        Span* span = PageCache::getInstance().mapObjectToSpan(current);
+        assert(span && span->objSize == SizeClass::classSize(index));
+        if (!span)
+        {
+            // PageCache 已经 shutdown，没地方还了
+            current = next;
+            continue;
+        }
+
+        // span原来是空的，说明不在链表上，重新挂回来
+        if (!span->freeList)
+        {
+            pushSpan(index, span);
+        }
+        *reinterpret_cast<void**>(current) = span->freeList;
+        span->freeList = current;
+
+        // span里的块全部空闲了，整个还给PageCache，让它和相邻页合并、给别的 size-class 复用
+        if (--span->useCount == 0)
+        {
+            unlinkSpan(index, span);
+            --spanCounts_[index];
+            PageCache::getInstance().deallocateSpan(span);
+        }
+
+        current = next;
     }
+}
 
-    locks_[index].clear(std::memory_order_release);
+void CentralCache::pushSpan(size_t index, Span* span)
+{
+    span->prev = nullptr;
+    span->next = spanLists_[index];
+    if (span->next) span->next->prev = span;
+    spanLists_[index] = span;
+}
+
+void CentralCache::unlinkSpan(size_t index, Span* span)
+{
+    if (span->prev) span->prev->next = span->next;
+    else spanLists_[index] = span->next;
+    if (span->next) span->next->prev = span->prev;
+    span->prev = nullptr;
+    span->next = nullptr;
 }
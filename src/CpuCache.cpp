@@ -0,0 +1,274 @@
+#include "CpuCache.h"
+#include "CentralCache.h"
+#include "LargeCache.h"
+#include "PageCache.h"
+#include <cassert>
+
+#if defined(MEMORYPOOL_PERCPU) && defined(__linux__) && defined(__x86_64__) && __has_include(<sys/rseq.h>)
+#define MEMORYPOOL_HAVE_RSEQ 1
+#include <sys/rseq.h>
+#include <sys/mman.h>
+#include <sys/sysinfo.h>
+#include <cstddef>
+
+// 临界区里按固定偏移直接访问 glibc 注册的 struct rseq
+static_assert(offsetof(struct rseq, cpu_id) == 4, "unexpected struct rseq layout");
+static_assert(offsetof(struct rseq, rseq_cs) == 8, "unexpected struct rseq layout");
+static_assert(RSEQ_SIG == 0x53053053, "unexpected rseq signature");
+#else
+#define MEMORYPOOL_HAVE_RSEQ 0
+#endif
+
+bool CpuCache::available()
+{
+    // 只初始化一次：检查 rseq、映射所有 CPU 的 slab
+    static const bool ok = init();
+    return ok;
+}
+
+bool CpuCache::setEnabled(bool enabled)
+{
+    if (enabled && !available()) return false;
+    enabled_.store(enabled, std::memory_order_relaxed);
+    return true;
+}
+
+bool CpuCache::init()
+{
+#if MEMORYPOOL_HAVE_RSEQ
+    // glibc 没有注册 rseq（内核太老，或者 glibc.pthread.rseq=0）
+    if (__rseq_size == 0) return false;
+
+    int cpu;
+    asm volatile("movl %%fs:4(%1), %0" : "=r"(cpu) : "r"(__rseq_offset));
+    if (cpu < 0) return false;
+
+    int numCpus = get_nprocs_conf();
+    if (numCpus <= 0 || cpu >= numCpus) return false;
+
+    // 只保留地址空间，哪个 CPU 的哪档用到了才缺页
+    void* slabs = mmap(nullptr, size_t(numCpus) << SLAB_SHIFT, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (slabs == MAP_FAILED) return false;
+
+    slabs_   = static_cast<char*>(slabs);
+    numCpus_ = size_t(numCpus);
+    return true;
+#else
+    return false;
+#endif
+}
+
+// 两个临界区的写法相同：先把 rseq_cs 指向本段的描述符，再读 CPU 号算出本 CPU 这一档的栈，
+// 最后一条指令写回块数即提交。被抢占/迁移/信号打断时内核跳到 abort（前面必须是 RSEQ_SIG），
+// abort 直接跳回开头重来；提交之前写过的槽都在栈顶之上，不影响别人
+void* CpuCache::pop(size_t index)
+{
+#if MEMORYPOOL_HAVE_RSEQ
+    void*     result;
+    uintptr_t hdr;
+    size_t    count;
+    asm volatile(
+        ".pushsection __rseq_cs, \"aw\"\n\t"
+        ".balign 32\n\t"
+        ".Lcs_%=:\n\t"
+        ".long 0, 0\n\t"
+        ".quad .Lstart_%=, .Lpost_%= - .Lstart_%=, .Labort_%=\n\t"
+        ".popsection\n\t"
+        ".pushsection __rseq_failure, \"ax\"\n\t"
+        ".byte 0x0f, 0xb9, 0x3d\n\t"
+        ".long 0x53053053\n\t"
+        ".Labort_%=:\n\t"
+        "jmp .Lretry_%=\n\t"
+        ".popsection\n\t"
+        ".Lretry_%=:\n\t"
+        "xorl %k[result], %k[result]\n\t"
+        "leaq .Lcs_%=(%%rip), %[hdr]\n\t"
+        "movq %[hdr], %%fs:8(%[rseq])\n\t"
+        ".Lstart_%=:\n\t"
+        "movl %%fs:4(%[rseq]), %k[hdr]\n\t"
+        "shlq %[shift], %[hdr]\n\t"
+        "addq %[base], %[hdr]\n\t"
+        "movq (%[hdr]), %[count]\n\t"
+        "testq %[count], %[count]\n\t"
+        "jz .Lpost_%=\n\t"
+        "movq (%[hdr], %[count], 8), %[result]\n\t"
+        "decq %[count]\n\t"
+        "movq %[count], (%[hdr])\n\t"
+        ".Lpost_%=:\n\t"
+        : [result] "=&r"(result), [hdr] "=&r"(hdr), [count] "=&r"(count)
+        : [rseq] "r"(__rseq_offset), [shift] "i"(SLAB_SHIFT),
+          [base] "r"(reinterpret_cast<uintptr_t>(slabs_) + LAYOUT.offset[index])
+        : "memory", "cc");
+    return result;
+#else
+    (void)index;
+    return nullptr;
+#endif
+}
+
+bool CpuCache::push(size_t index, void* ptr)
+{
+#if MEMORYPOOL_HAVE_RSEQ
+    uint32_t  ok;
+    uintptr_t hdr;
+    size_t    count;
+    asm volatile(
+        ".pushsection __rseq_cs, \"aw\"\n\t"
+        ".balign 32\n\t"
+        ".Lcs_%=:\n\t"
+        ".long 0, 0\n\t"
+        ".quad .Lstart_%=, .Lpost_%= - .Lstart_%=, .Labort_%=\n\t"
+        ".popsection\n\t"
+        ".pushsection __rseq_failure, \"ax\"\n\t"
+        ".byte 0x0f, 0xb9, 0x3d\n\t"
+        ".long 0x53053053\n\t"
+        ".Labort_%=:\n\t"
+        "jmp .Lretry_%=\n\t"
+        ".popsection\n\t"
+        ".Lretry_%=:\n\t"
+        "xorl %k[ok], %k[ok]\n\t"
+        "leaq .Lcs_%=(%%rip), %[hdr]\n\t"
+        "movq %[hdr], %%fs:8(%[rseq])\n\t"
+        ".Lstart_%=:\n\t"
+        "movl %%fs:4(%[rseq]), %k[hdr]\n\t"
+        "shlq %[shift], %[hdr]\n\t"
+        "addq %[base], %[hdr]\n\t"
+        "movq (%[hdr]), %[count]\n\t"
+        "cmpq %[cap], %[count]\n\t"
+        "jae .Lpost_%=\n\t"
+        "movq %[ptr], 8(%[hdr], %[count], 8)\n\t"
+        "incq %[count]\n\t"
+        "movl $1, %k[ok]\n\t"
+        "movq %[count], (%[hdr])\n\t"
+        ".Lpost_%=:\n\t"
+        : [ok] "=&r"(ok), [hdr] "=&r"(hdr), [count] "=&r"(count)
+        : [rseq] "r"(__rseq_offset), [shift] "i"(SLAB_SHIFT),
+          [base] "r"(reinterpret_cast<uintptr_t>(slabs_) + LAYOUT.offset[index]),
+          [cap] "r"(LAYOUT.capacity[index]), [ptr] "r"(ptr)
+        : "memory", "cc");
+    return ok != 0;
+#else
+    (void)index;
+    (void)ptr;
+    return false;
+#endif
+}
+
+void* CpuCache::allocate(size_t size)
+{
+    if (size == 0)
+    {
+        size = ALIGNMENT;
+    }
+
+    if (size > MAX_BYTES)
+    {
+        return LargeCache::getInstance().allocate(size);
+    }
+
+    return allocateClass(SizeClass::getIndex(size));
+}
+
+void CpuCache::deallocate(void* ptr, size_t size)
+{
+    if (size > MAX_BYTES)
+    {
+        PageCache::Span* span = PageCache::getInstance().mapObjectToSpan(ptr);
+        assert(span && span->isLarge);
+        LargeCache::getInstance().deallocate(span);
+        return;
+    }
+
+    freeToCpu(SizeClass::getIndex(size), ptr);
+}
+
+void CpuCache::deallocate(void* ptr)
+{
+    PageCache::Span* span = PageCache::getInstance().mapObjectToSpan(ptr);
+    assert(span);
+    if (!span) return;
+
+    if (span->isLarge)
+    {
+        LargeCache::getInstance().deallocate(span);
+        return;
+    }
+
+    freeToCpu(span->sizeClass, ptr);
+}
+
+void* CpuCache::refill(size_t index)
+{
+    // 取半栈加一块：一块给用户，其余压到当前 CPU 上
+    refills_[index].fetch_add(1, std::memory_order_relaxed);
+    void* start = nullptr;
+    void* end = nullptr;
+    size_t count = CentralCache::getInstance().fetchRange(index, LAYOUT.capacity[index] / 2 + 1, start, end);
+    if (count == 0) return nullptr;
+
+    void* current = *reinterpret_cast<void**>(start);
+    --count;
+    while (count)
+    {
+        // 压栈之后这块可能马上被同一 CPU 上的别的线程拿走，先读出下一块
+        void* next = *reinterpret_cast<void**>(current);
+        if (!push(index, current)) break;
+        current = next;
+        --count;
+    }
+
+    // 取回来的批次比栈剩的空间多，多出来的原样还回去
+    if (count)
+    {
+        CentralCache::getInstance().returnRange(current, end, count, index);
+    }
+    return start;
+}
+
+void CpuCache::overflow(size_t index, void* ptr)
+{
+    void* head = ptr;
+    void* tail = ptr;
+    *reinterpret_cast<void**>(ptr) = nullptr;
+    size_t count = 1;
+
+    const size_t drain = LAYOUT.capacity[index] / 2;
+    while (count <= drain)
+    {
+        void* obj = pop(index);
+        if (!obj) break;
+        *reinterpret_cast<void**>(obj) = head;
+        head = obj;
+        ++count;
+    }
+
+    overflows_[index].fetch_add(1, std::memory_order_relaxed);
+    CentralCache::getInstance().returnRange(head, tail, count, index);
+}
+
+size_t CpuCache::cachedBytes()
+{
+    if (!slabs_) return 0;
+
+    size_t total = 0;
+    for (size_t cpu = 0; cpu < numCpus_; ++cpu)
+    {
+        char* slab = slabs_ + (cpu << SLAB_SHIFT);
+        for (size_t index = 0; index < FREE_LIST_SIZE; ++index)
+        {
+            size_t count = __atomic_load_n(reinterpret_cast<size_t*>(slab + LAYOUT.offset[index]), __ATOMIC_RELAXED);
+            total += count * SizeClass::classSize(index);
+        }
+    }
+    return total;
+}
+
+CpuCache::ClassStats CpuCache::classStats(size_t index)
+{
+    ClassStats stats{};
+    if (index >= FREE_LIST_SIZE) return stats;
+    stats.refills   = refills_[index].load(std::memory_order_relaxed);
+    stats.overflows = overflows_[index].load(std::memory_order_relaxed);
+    return stats;
+}
@@ -0,0 +1,423 @@
+#include "HeapProfiler.h"
+#include "LargeCache.h"
+#include "PageCache.h"
+#include "MetaArena.h"
+#include "StringFormat.h"
+#include <unwind.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <new>
+
+namespace
+{
+    using detail::appendf;
+
+    constexpr size_t REGION_BYTES   = size_t(1) << HeapProfiler::REGION_SHIFT; // 采样区只占地址空间，用到哪页才有物理页
+    constexpr size_t MAX_SLOT_PAGES = MAX_BYTES / PAGE_SIZE;  // 采样区里最大的小对象占的页数
+    constexpr size_t MAX_DEPTH      = 32;                     // 调用栈最多记这么多层
+    constexpr size_t SKIP_FRAMES    = 2;                      // captureStack 和 HeapProfiler::allocate 自己
+    constexpr size_t HASH_BUCKETS   = 1024;
+
+    // 一个调用栈的累计数：打开以来分配/释放了多少个采样、多少字节
+    struct StackBucket
+    {
+        StackBucket* next; // 哈希链
+        uint64_t hash;
+        size_t   depth;
+        void*    frames[MAX_DEPTH];
+        size_t   allocs;
+        size_t   allocBytes;
+        size_t   frees;
+        size_t   freeBytes;
+    };
+
+    // 活着的采样：请求的大小、调用栈、占采样区的页数（大对象为 0）
+    struct LiveSample
+    {
+        size_t       size;
+        StackBucket* bucket;
+        size_t       pages;
+    };
+
+    // 所有状态都在锁里，锁只在采样和释放采样对象的慢路径上拿
+    struct ProfileState
+    {
+        SpinLock lock;
+        char*    regionCursor = nullptr; // 采样区还没切过的部分
+        char*    regionEnd    = nullptr;
+        std::array<void*, MAX_SLOT_PAGES + 1> freeSlots{}; // 按页数分的空闲槽，槽的第一个字存下一个
+        std::array<StackBucket*, HASH_BUCKETS> buckets{};
+        MetaArena<StackBucket> bucketArena;
+        std::map<uintptr_t, LiveSample, std::less<uintptr_t>,
+                 MetaAllocator<std::pair<const uintptr_t, LiveSample>>> live;
+        size_t liveBytes    = 0;
+        size_t totalSamples = 0;
+        size_t totalBytes   = 0;
+    };
+
+    ProfileState& state()
+    {
+#ifdef MEMORYPOOL_MALLOC_SHIM
+        // 和 PageCache 一样不析构：进程退出途中还会有采样对象被释放
+        alignas(ProfileState) static char storage[sizeof(ProfileState)];
+        static ProfileState* instance = new (storage) ProfileState();
+        return *instance;
+#else
+        static ProfileState instance;
+        return instance;
+#endif
+    }
+
+    std::atomic<size_t> sampleBytes{HeapProfiler::DEFAULT_SAMPLE_BYTES};
+
+    // 本线程正在采样或导出：这期间的分配不采样，也就不会重入锁
+    thread_local bool busy = false;
+    thread_local uint64_t rngState = 0;
+
+    uint64_t nextRandom()
+    {
+        if (rngState == 0)
+        {
+            // 每个线程用自己的 TLS 地址和时间播种
+            rngState = reinterpret_cast<uintptr_t>(&rngState) ^
+                       static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count()) ^
+                       0x9e3779b97f4a7c15ULL;
+        }
+        // xorshift64*
+        rngState ^= rngState >> 12;
+        rngState ^= rngState << 25;
+        rngState ^= rngState >> 27;
+        return rngState * 0x2545f4914f6cdd1dULL;
+    }
+
+    // 下一次采样前还要分配的字节数：均值为 mean 的指数分布，
+    // 等价于每个字节独立地以 1/mean 的概率被选中，pprof 按这个模型把采样数放大回真实值
+    size_t nextInterval(size_t mean)
+    {
+        double u = static_cast<double>(nextRandom() >> 11) * (1.0 / 9007199254740992.0); // [0, 1)
+        return static_cast<size_t>(-std::log(1.0 - u) * static_cast<double>(mean)) + 1;
+    }
+
+    struct TraceState
+    {
+        void** frames;
+        size_t depth;
+        size_t skip;
+    };
+
+    _Unwind_Reason_Code traceFrame(_Unwind_Context* context, void* arg)
+    {
+        TraceState* trace = static_cast<TraceState*>(arg);
+        uintptr_t ip = _Unwind_GetIP(context);
+        if (ip == 0) return _URC_END_OF_STACK;
+        if (trace->skip)
+        {
+            --trace->skip;
+            return _URC_NO_REASON;
+        }
+        trace->frames[trace->depth++] = reinterpret_cast<void*>(ip);
+        return trace->depth < MAX_DEPTH ? _URC_NO_REASON : _URC_END_OF_STACK;
+    }
+
+    // 用 libgcc 的展开器而不是 glibc 的 backtrace()：后者第一次调用时会 dlopen，里面要 malloc
+    __attribute__((noinline)) size_t captureStack(void** frames)
+    {
+        TraceState trace{frames, 0, SKIP_FRAMES};
+        _Unwind_Backtrace(traceFrame, &trace);
+        return trace.depth;
+    }
+
+    uint64_t hashStack(void* const* frames, size_t depth)
+    {
+        uint64_t h = 0xcbf29ce484222325ULL;
+        for (size_t i = 0; i < depth; ++i)
+        {
+            h = (h ^ reinterpret_cast<uintptr_t>(frames[i])) * 0x100000001b3ULL;
+        }
+        return h;
+    }
+
+    // 以下都要求持有 state().lock
+
+    StackBucket* findBucket(ProfileState& s, void* const* frames, size_t depth)
+    {
+        uint64_t hash = hashStack(frames, depth);
+        StackBucket*& head = s.buckets[hash % HASH_BUCKETS];
+        for (StackBucket* b = head; b; b = b->next)
+        {
+            if (b->hash == hash && b->depth == depth &&
+                std::memcmp(b->frames, frames, depth * sizeof(void*)) == 0)
+            {
+                return b;
+            }
+        }
+
+        void* mem = s.bucketArena.allocate();
+        if (!mem) return nullptr;
+        StackBucket* b = static_cast<StackBucket*>(mem);
+        b->hash  = hash;
+        b->depth = depth;
+        std::memcpy(b->frames, frames, depth * sizeof(void*));
+        b->next = head;
+        head = b;
+        return b;
+    }
+
+    void* takeSlot(ProfileState& s, size_t pages)
+    {
+        if (void* slot = s.freeSlots[pages])
+        {
+            s.freeSlots[pages] = *static_cast<void**>(slot);
+            return slot;
+        }
+        if (static_cast<size_t>(s.regionEnd - s.regionCursor) < pages * PAGE_SIZE) return nullptr;
+        void* slot = s.regionCursor;
+        s.regionCursor += pages * PAGE_SIZE;
+        return slot;
+    }
+
+    void putSlot(ProfileState& s, void* slot, size_t pages)
+    {
+        *static_cast<void**>(slot) = s.freeSlots[pages];
+        s.freeSlots[pages] = slot;
+    }
+
+    // 释放一个活着的采样，返回它占的采样区页数
+    size_t forget(ProfileState& s, uintptr_t addr)
+    {
+        auto it = s.live.find(addr);
+        if (it == s.live.end()) return 0;
+
+        const LiveSample& sample = it->second;
+        sample.bucket->frees     += 1;
+        sample.bucket->freeBytes += sample.size;
+        s.liveBytes -= sample.size;
+        size_t pages = sample.pages;
+        s.live.erase(it);
+        return pages;
+    }
+
+    // pprof 符号化要知道各个模块映射在哪
+    void appendMappedLibraries(std::string& out)
+    {
+        out += "\nMAPPED_LIBRARIES:\n";
+        int fd = open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return;
+        char buf[4096];
+        ssize_t n;
+        while ((n = read(fd, buf, sizeof(buf))) > 0)
+        {
+            out.append(buf, static_cast<size_t>(n));
+        }
+        close(fd);
+    }
+}
+
+bool HeapProfiler::start(size_t bytes)
+{
+    ProfileState& s = state();
+    std::lock_guard<SpinLock> guard(s.lock);
+
+    // 采样区第一次打开时映射，之后一直保留：关掉以后采样对象还会陆续释放回来
+    if (!s.regionEnd)
+    {
+        // 多映射一倍再把没对齐的首尾还回去，留下按 REGION_BYTES 对齐的一段
+        char* raw = static_cast<char*>(mmap(nullptr, 2 * REGION_BYTES, PROT_READ | PROT_WRITE,
+                                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0));
+        if (raw == MAP_FAILED) return false;
+        char* base = reinterpret_cast<char*>(
+            (reinterpret_cast<uintptr_t>(raw) + REGION_BYTES - 1) & ~(REGION_BYTES - 1));
+        if (base > raw) munmap(raw, base - raw);
+        munmap(base + REGION_BYTES, raw + REGION_BYTES - base);
+
+        s.regionCursor = base;
+        s.regionEnd    = base + REGION_BYTES;
+        regionTag_.store(reinterpret_cast<uintptr_t>(base) >> REGION_SHIFT, std::memory_order_relaxed);
+    }
+
+    sampleBytes.store(std::max<size_t>(bytes, 1), std::memory_order_relaxed);
+    enabled_.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+void HeapProfiler::stop()
+{
+    enabled_.store(false, std::memory_order_relaxed);
+}
+
+void* HeapProfiler::allocate(size_t size)
+{
+    if (!running())
+    {
+        bytesUntilSample_ = DISABLED_INTERVAL;
+        return nullptr;
+    }
+    if (busy) return nullptr;
+
+    bytesUntilSample_ = nextInterval(sampleBytes.load(std::memory_order_relaxed));
+    busy = true;
+
+    void* frames[MAX_DEPTH];
+    size_t depth = captureStack(frames);
+
+    if (size == 0) size = ALIGNMENT;
+    ProfileState& s = state();
+    void* ptr = nullptr;
+    size_t pages = 0;
+    if (size > MAX_BYTES)
+    {
+        // 大对象照常分配，span 上打标记，LargeCache 释放它时会通知 recordFree
+        ptr = LargeCache::getInstance().allocate(size);
+        if (ptr) PageCache::getInstance().mapObjectToSpan(ptr)->sampled = true;
+    }
+    else
+    {
+        // 按 size-class 的块大小占页：原地 realloc 只看块大小，槽不能比块小
+        pages = (SizeClass::roundUp(size) + PAGE_SIZE - 1) / PAGE_SIZE;
+        std::lock_guard<SpinLock> guard(s.lock);
+        ptr = takeSlot(s, pages);
+    }
+
+    if (ptr)
+    {
+        std::lock_guard<SpinLock> guard(s.lock);
+        StackBucket* bucket = findBucket(s, frames, depth);
+        bool recorded = false;
+        if (bucket)
+        {
+            try
+            {
+                s.live.emplace(reinterpret_cast<uintptr_t>(ptr), LiveSample{size, bucket, pages});
+                recorded = true;
+            }
+            catch (const std::bad_alloc&)
+            {
+            }
+        }
+
+        if (recorded)
+        {
+            bucket->allocs     += 1;
+            bucket->allocBytes += size;
+            s.liveBytes    += size;
+            s.totalSamples += 1;
+            s.totalBytes   += size;
+        }
+        else if (pages)
+        {
+            // 元数据不够记不下来，槽还回去，让调用方照常分配
+            putSlot(s, ptr, pages);
+            ptr = nullptr;
+        }
+        else
+        {
+            PageCache::getInstance().mapObjectToSpan(ptr)->sampled = false;
+        }
+    }
+
+    busy = false;
+    return ptr;
+}
+
+void HeapProfiler::deallocate(void* ptr)
+{
+    ProfileState& s = state();
+    std::lock_guard<SpinLock> guard(s.lock);
+
+    // 槽留着常驻，下一个同样页数的采样直接复用，不再缺页；常驻量不超过同时活着的采样最多时占的页
+    size_t pages = forget(s, reinterpret_cast<uintptr_t>(ptr));
+    if (pages) putSlot(s, ptr, pages);
+}
+
+size_t HeapProfiler::usableSize(const void* ptr)
+{
+    ProfileState& s = state();
+    std::lock_guard<SpinLock> guard(s.lock);
+    auto it = s.live.find(reinterpret_cast<uintptr_t>(ptr));
+    return it == s.live.end() ? 0 : it->second.pages * PAGE_SIZE;
+}
+
+void HeapProfiler::recordFree(void* ptr)
+{
+    ProfileState& s = state();
+    std::lock_guard<SpinLock> guard(s.lock);
+    forget(s, reinterpret_cast<uintptr_t>(ptr));
+}
+
+HeapProfiler::Stats HeapProfiler::stats()
+{
+    ProfileState& s = state();
+    std::lock_guard<SpinLock> guard(s.lock);
+
+    Stats stats;
+    stats.sampleBytes  = sampleBytes.load(std::memory_order_relaxed);
+    stats.liveSamples  = s.live.size();
+    stats.liveBytes    = s.liveBytes;
+    stats.totalSamples = s.totalSamples;
+    stats.totalBytes   = s.totalBytes;
+    return stats;
+}
+
+std::string HeapProfiler::heapProfile()
+{
+    return dump(true);
+}
+
+std::string HeapProfiler::allocationProfile()
+{
+    return dump(false);
+}
+
+std::string HeapProfiler::dump(bool liveOnly)
+{
+    // 拼字符串时要分配内存：本线程标记为忙，这些分配不会被采样，也就不会回头来抢锁
+    const bool wasBusy = busy;
+    busy = true;
+
+    std::string out;
+    {
+        ProfileState& s = state();
+        std::lock_guard<SpinLock> guard(s.lock);
+
+        size_t inuseCount = 0, inuseBytes = 0, allocCount = 0, allocBytes = 0;
+        for (StackBucket* head : s.buckets)
+        {
+            for (StackBucket* b = head; b; b = b->next)
+            {
+                if (liveOnly && b->allocs == b->frees) continue;
+                inuseCount += b->allocs - b->frees;
+                inuseBytes += b->allocBytes - b->freeBytes;
+                allocCount += b->allocs;
+                allocBytes += b->allocBytes;
+            }
+        }
+
+        // heap_v2：每行 在用个数: 在用字节 [累计个数: 累计字节] @ 调用栈
+        appendf(out, "heap profile: %6zu: %8zu [%6zu: %8zu] @ heap_v2/%zu\n",
+                inuseCount, inuseBytes, allocCount, allocBytes, sampleBytes.load(std::memory_order_relaxed));
+        for (StackBucket* head : s.buckets)
+        {
+            for (StackBucket* b = head; b; b = b->next)
+            {
+                if (liveOnly && b->allocs == b->frees) continue;
+                appendf(out, "%6zu: %8zu [%6zu: %8zu] @", b->allocs - b->frees, b->allocBytes - b->freeBytes,
+                        b->allocs, b->allocBytes);
+                for (size_t i = 0; i < b->depth; ++i)
+                {
+                    appendf(out, " 0x%016" PRIxPTR, reinterpret_cast<uintptr_t>(b->frames[i]));
+                }
+                out += '\n';
+            }
+        }
+    }
+    appendMappedLibraries(out);
+
+    busy = wasBusy;
+    return out;
+}
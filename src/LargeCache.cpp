@@ -0,0 +1,203 @@
+#include "LargeCache.h"
+#include "HeapProfiler.h"
+#include <sys/mman.h>
+#include <cstring>
+
+void* LargeCache::allocate(size_t size)
+{
+    size_t numPages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+    Span* span = nullptr;
+
+    if (numPages <= MAX_CACHED_PAGES)
+    {
+        // 允许拿稍大一点的（多出的不超过 1/8），这个页数可能落在下一个桶里
+        size_t maxPages = numPages + numPages / 8;
+        std::lock_guard<SpinLock> guard(lock_);
+
+        size_t bucket = bucketOf(numPages);
+        span = take(bucket, numPages, maxPages);
+        if (!span && bucket + 1 < NUM_BUCKETS)
+        {
+            span = take(bucket + 1, numPages, maxPages);
+        }
+
+        if (span)
+        {
+            ++hits_;
+            ++inUseSpans_;
+            inUsePages_ += span->numPages;
+            return span->pageAddr;
+        }
+    }
+
+    // 缓存没命中，按页向 PageCache 要
+    span = PageCache::getInstance().allocateSpan(numPages);
+    if (!span) return nullptr;
+
+    span->isLarge = true;
+    span->objSize = span->numPages * PAGE_SIZE;
+
+    std::lock_guard<SpinLock> guard(lock_);
+    ++misses_;
+    ++inUseSpans_;
+    inUsePages_ += span->numPages;
+    return span->pageAddr;
+}
+
+LargeCache::Span* LargeCache::take(size_t bucket, size_t numPages, size_t maxPages)
+{
+    Bucket& b = buckets_[bucket];
+
+    size_t best = b.count;
+    for (size_t i = 0; i < b.count; ++i)
+    {
+        size_t pages = b.entries[i]->numPages;
+        if (pages >= numPages && pages <= maxPages &&
+            (best == b.count || pages < b.entries[best]->numPages))
+        {
+            best = i;
+        }
+    }
+    if (best == b.count) return nullptr;
+
+    Span* span = b.entries[best];
+    for (size_t i = best + 1; i < b.count; ++i)
+    {
+        b.entries[i - 1] = b.entries[i];
+    }
+    --b.count;
+    --cachedSpans_;
+    cachedPages_ -= span->numPages;
+    return span;
+}
+
+void LargeCache::deallocate(Span* span)
+{
+    if (span->sampled)
+    {
+        span->sampled = false;
+        HeapProfiler::recordFree(span->pageAddr);
+    }
+
+    Span* evicted = nullptr;
+    {
+        std::lock_guard<SpinLock> guard(lock_);
+        --inUseSpans_;
+        inUsePages_ -= span->numPages;
+
+        // 太大的不缓存；放得下就放进桶里，桶满了把最老的挤出去
+        if (span->numPages <= MAX_CACHED_PAGES &&
+            (cachedPages_ + span->numPages) * PAGE_SIZE <= MAX_CACHED_BYTES)
+        {
+            Bucket& b = buckets_[bucketOf(span->numPages)];
+            if (b.count == ENTRIES_PER_BUCKET)
+            {
+                evicted = b.entries[0];
+                for (size_t i = 1; i < b.count; ++i)
+                {
+                    b.entries[i - 1] = b.entries[i];
+                }
+                --b.count;
+                --cachedSpans_;
+                cachedPages_ -= evicted->numPages;
+            }
+            b.entries[b.count++] = span;
+            ++cachedSpans_;
+            cachedPages_ += span->numPages;
+            span = nullptr;
+        }
+    }
+
+    // 和 PageCache 打交道放在锁外
+    if (evicted) PageCache::getInstance().deallocateSpan(evicted);
+    if (span) PageCache::getInstance().deallocateSpan(span);
+}
+
+void* LargeCache::reallocate(void* ptr, size_t newSize)
+{
+    PageCache& pc = PageCache::getInstance();
+    Span* span = pc.mapObjectToSpan(ptr);
+    if (!span || !span->isLarge) return nullptr;
+
+    const size_t oldPages = span->numPages;
+    const size_t newPages = (newSize + PAGE_SIZE - 1) / PAGE_SIZE;
+
+    // 按页以上对齐返回的块起点在span中间，不做原地伸缩
+    if (ptr == span->pageAddr)
+    {
+        // 缩得不多（不到 1/8）就原样留着，省得切出一堆碎片
+        if (newPages <= oldPages && newPages >= oldPages - oldPages / 8) return ptr;
+
+        if (pc.resizeSpan(span, newPages))
+        {
+            span->objSize = newPages * PAGE_SIZE;
+
+            std::lock_guard<SpinLock> guard(lock_);
+            inUsePages_ = inUsePages_ + newPages - oldPages;
+            return ptr;
+        }
+    }
+
+    void* fresh = allocate(newSize);
+    if (!fresh) return nullptr;
+
+    const size_t oldBytes = static_cast<char*>(span->pageAddr) + span->objSize - static_cast<char*>(ptr);
+    const size_t bytes = std::min(oldBytes, newPages * PAGE_SIZE);
+    if (ptr != span->pageAddr || bytes < MREMAP_MIN_BYTES || !movePages(ptr, fresh, bytes))
+    {
+        std::memcpy(fresh, ptr, std::min(oldBytes, newSize));
+    }
+
+    deallocate(span);
+    return fresh;
+}
+
+bool LargeCache::movePages(void* src, void* dst, size_t bytes)
+{
+#ifdef MREMAP_DONTUNMAP
+    // MREMAP_FIXED 先拆掉 dst 原来的映射，再把 src 的页表项整体挪过去；
+    // DONTUNMAP 让 src 的地址范围留在原处（之后按需补零页），它仍然属于 PageCache，不会被别人 mmap 走
+    return mremap(src, bytes, bytes, MREMAP_MAYMOVE | MREMAP_FIXED | MREMAP_DONTUNMAP, dst) != MAP_FAILED;
+#else
+    (void)src;
+    (void)dst;
+    (void)bytes;
+    return false;
+#endif
+}
+
+void LargeCache::flush()
+{
+    while (true)
+    {
+        Span* span = nullptr;
+        {
+            std::lock_guard<SpinLock> guard(lock_);
+            for (Bucket& b : buckets_)
+            {
+                if (b.count)
+                {
+                    span = b.entries[--b.count];
+                    --cachedSpans_;
+                    cachedPages_ -= span->numPages;
+                    break;
+                }
+            }
+        }
+        if (!span) break;
+        PageCache::getInstance().deallocateSpan(span);
+    }
+}
+
+LargeCache::Stats LargeCache::stats()
+{
+    std::lock_guard<SpinLock> guard(lock_);
+    Stats s;
+    s.inUseSpans  = inUseSpans_;
+    s.inUseBytes  = inUsePages_ * PAGE_SIZE;
+    s.cachedSpans = cachedSpans_;
+    s.cachedBytes = cachedPages_ * PAGE_SIZE;
+    s.hits        = hits_;
+    s.misses      = misses_;
+    return s;
+}
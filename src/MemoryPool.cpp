@@ -0,0 +1,97 @@
+#include "MemoryPool.h"
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+void* MemoryPool::allocateAligned(size_t size, size_t alignment)
+{
+    assert(alignment && !(alignment & (alignment - 1)));
+
+    size_t bytes = alignedSize(size, alignment);
+    if (bytes == 0) return nullptr;
+
+    void* ptr = allocate(bytes);
+    if (!ptr || alignment <= PAGE_SIZE) return ptr;
+
+    // 大对象起点按页对齐，往后挪到 alignment 的整数倍，最多挪 alignment - PAGE_SIZE 字节
+    return reinterpret_cast<void*>((reinterpret_cast<uintptr_t>(ptr) + alignment - 1) & ~(alignment - 1));
+}
+
+void* MemoryPool::reallocate(void* ptr, size_t oldSize, size_t newSize)
+{
+    if (!ptr) return allocate(newSize);
+    if (newSize == 0)
+    {
+        deallocate(ptr, oldSize);
+        return nullptr;
+    }
+
+    if (oldSize <= MAX_BYTES)
+    {
+        // 还在原来的块里，缩得也不多，不用动
+        size_t blockSize = SizeClass::roundUp(oldSize);
+        if (newSize <= blockSize && newSize >= blockSize / 2) return ptr;
+    }
+    else if (newSize > MAX_BYTES)
+    {
+        // 大对象到大对象：原地伸缩，或者换块时由 LargeCache 搬页
+        return LargeCache::getInstance().reallocate(ptr, newSize);
+    }
+
+    void* fresh = allocate(newSize);
+    if (!fresh) return nullptr;
+    std::memcpy(fresh, ptr, std::min(oldSize, newSize));
+    deallocate(ptr, oldSize);
+    return fresh;
+}
+
+PoolStats MemoryPool::stats()
+{
+    PoolStats stats{};
+
+    const auto threadStats = ThreadCache::allClassStats();
+    CentralCache& central = CentralCache::getInstance();
+    for (size_t index = 0; index < FREE_LIST_SIZE; ++index)
+    {
+        const size_t size = SizeClass::classSize(index);
+        const ThreadCache::ClassStats& ts = threadStats[index];
+        const CpuCache::ClassStats cs = CpuCache::classStats(index);
+        const CentralCache::ClassStats cc = central.classStats(index);
+
+        PoolStats::SizeClassStats& out = stats.classes[index];
+        out.size              = size;
+        out.allocs            = ts.allocs;
+        out.frees             = ts.frees;
+        out.refills           = ts.misses + cs.refills;
+        out.spills            = ts.overflows + cs.overflows;
+        out.threadCacheBlocks = ts.cachedBlocks;
+        out.transferBlocks    = cc.transferBlocks;
+        out.centralFreeBlocks = cc.freeBlocks;
+        out.spans             = cc.spans;
+
+        stats.threadCacheBytes   += ts.cachedBlocks * size;
+        stats.transferCacheBytes += cc.transferBlocks * size;
+        stats.centralCacheBytes  += cc.freeBlocks * size;
+    }
+    stats.cpuCacheBytes = CpuCache::cachedBytes();
+
+    const LargeCache::Stats large = LargeCache::getInstance().stats();
+    stats.largeCacheBytes = large.cachedBytes;
+    stats.largeInUseBytes = large.inUseBytes;
+    stats.largeAllocs     = large.hits + large.misses;
+    stats.largeCacheHits  = large.hits;
+
+    PageCache& pageCache = PageCache::getInstance();
+    const PageCache::SpanStats spans = pageCache.spanStats();
+    const PageCache::ReleaseStats release = pageCache.releaseStats();
+    stats.pageHeapFreeBytes     = (spans.freePages - spans.releasedPages) * PAGE_SIZE;
+    stats.pageHeapReleasedBytes = spans.releasedPages * PAGE_SIZE;
+    stats.spansInUse            = spans.spansInUse;
+    stats.pagesInUse            = spans.pagesInUse;
+    stats.freeSpans             = spans.freeSpans;
+    stats.freePages             = spans.freePages;
+    stats.mappedBytes           = spans.mappedBytes;
+    stats.totalReleasedBytes    = release.totalReleasedBytes;
+    stats.releaseCount          = release.releaseCount;
+    return stats;
+}
@@ -2,172 +2,693 @@
 #include "Common.h"
 #include <sys/mman.h>
 #include <cstring>
+#include <chrono>
 
-void* PageCache::allocateSpan(size_t numPages)
+namespace
 {
-    std::lock_guard<std::mutex> lock(mutex_);
+    // 新线程按轮转分到各个 arena
+    std::atomic<size_t> nextArena{0};
+}
+
+size_t PageCache::homeArena()
+{
+    static thread_local const size_t id = nextArena.fetch_add(1, std::memory_order_relaxed) % NUM_ARENAS;
+    return id;
+}
+
+PageCache::Span* PageCache::allocateSpan(size_t numPages)
+{
+    const size_t home = homeArena();
+    {
+        std::lock_guard<std::mutex> lock(arenas_[home].mutex);
+        if (Span* span = allocateFromArena(home, numPages)) return span;
+    }
+
+    // 本 arena 没有合适的：去别的 arena 借一个空闲span，锁被占着就跳过，不排队
+    // 借走的span仍然属于原来的 arena，释放时还回去
+    for (size_t i = 1; i < NUM_ARENAS; ++i)
+    {
+        size_t id = (home + i) % NUM_ARENAS;
+        std::unique_lock<std::mutex> lock(arenas_[id].mutex, std::try_to_lock);
+        if (!lock.owns_lock()) continue;
+        if (Span* span = allocateFromArena(id, numPages)) return span;
+    }
+
+    Arena& arena = arenas_[home];
+    std::lock_guard<std::mutex> lock(arena.mutex);
+
+    // 放开锁的这段时间里可能有span还回来了
+    if (Span* span = allocateFromArena(home, numPages)) return span;
+
+    // 没有合适的span，向系统申请，新区域归本 arena；普通模式刚好够numPages页，大页模式是整块 2MB 区域
+    size_t allocPages = numPages;
+    void* memory = systemAlloc(arena, allocPages);
+    if (!memory) return nullptr;
+
+    // 创建新的span
+    Span* span = newSpan(home);
+    if (!span)
+    {
+        munmap(memory, allocPages * PAGE_SIZE);
+        mappedBytes_.fetch_sub(allocPages * PAGE_SIZE, std::memory_order_relaxed);
+        return nullptr;
+    }
+    span->pageAddr = memory;
+    span->numPages = allocPages;
+    span->freeSince = nowMs();
+    return carveSpan(span, numPages);
+}
+
+PageCache::Span* PageCache::allocateFromArena(size_t arenaId, size_t numPages)
+{
+    // 查找合适的空闲span：最小的、页数 >= numPages 的那个
+    Span* span = findFreeSpan(arenas_[arenaId], numPages);
+    if (!span) return nullptr;
+
+    removeFreeSpan(span);
+    return carveSpan(span, numPages);
+}
+
+PageCache::Span* PageCache::carveSpan(Span* span, size_t numPages)
+{
+    // 如果span大于需要的numPages则进行分割（元数据都要不到时就整个给出去）
+    // 总是从低地址切走，剩下的留在原处，同一块区域里的span紧挨着排布
+    Span* rest = (span->numPages > numPages)
+                     ? newSpan(span->arena.load(std::memory_order_relaxed) - 1) : nullptr;
+    if (rest) 
+    {
+        //rest就是要切走的页，保持原来的状态放回空闲索引
+        rest->pageAddr = static_cast<char*>(span->pageAddr) + 
+                         numPages * PAGE_SIZE;
+        rest->numPages = span->numPages - numPages;
+        rest->released = span->released;
+        rest->freeSince = span->freeSince;
+        span->numPages = numPages;
+        insertFreeSpan(rest);
+    }
+
+    // 已经还给系统的页再次使用时由内核按需补零页，不需要额外处理
+    span->released = false;
+
+    // 已分配的span登记每一页，ThreadCache/CentralCache 拿任意块地址都能 O(1) 查到span
+    span->next = nullptr;
+    span->prev = nullptr;
+    pageMap_.setRange(PageMap<Span>::pageIdOf(span->pageAddr), span->numPages, span);
+    pagesInUse_.fetch_add(span->numPages, std::memory_order_relaxed);
+    spansInUse_.fetch_add(1, std::memory_order_relaxed);
+    return span;
+}
+
+PageCache::Span* PageCache::newSpan(size_t arenaId)
+{
+    // Span 元数据从专用的 MetaArena 里切，不在持锁时调用系统 new/delete，而且都挤在一起，局部性更好
+    void* mem = spanArena_.allocate();
+    if (!mem) return nullptr;
+    Span* span = new (mem) Span{};
+    span->arena.store(static_cast<uint8_t>(arenaId + 1), std::memory_order_relaxed);
+    return span;
+}
+
+void PageCache::deleteSpan(Span* span)
+{
+    // 先摘掉归属，页表里残留的旧指针再被别的 arena 查到时不会被当成自己的
+    span->arena.store(0, std::memory_order_relaxed);
+    span->~Span();
+    spanArena_.deallocate(span);
+}
+
+PageCache::Span* PageCache::findFreeSpan(Arena& arena, size_t numPages)
+{
+    // 两个索引各自做最佳适配，取页数更小的；一样大时优先用还常驻的，省掉缺页
+    Span* normal = arena.normalSpans.find(numPages);
+    Span* released = arena.releasedSpans.find(numPages);
+    if (!released) return normal;
+    if (!normal) return released;
+    return normal->numPages <= released->numPages ? normal : released;
+}
+
+void PageCache::insertFreeSpan(Span* span)
+{
+    span->isFree = true;
+    registerFreeSpan(span);
+    freeSpans_.fetch_add(1, std::memory_order_relaxed);
+
+    Arena& arena = arenaOf(span);
+    if (span->released)
+    {
+        arena.releasedSpans.insert(span);
+        releasedFreePages_.fetch_add(span->numPages, std::memory_order_relaxed);
+    }
+    else
+    {
+        arena.normalSpans.insert(span);
+        normalFreePages_.fetch_add(span->numPages, std::memory_order_relaxed);
+    }
+}
+
+void PageCache::removeFreeSpan(Span* span)
+{
+    Arena& arena = arenaOf(span);
+    if (span->released)
+    {
+        arena.releasedSpans.remove(span);
+        releasedFreePages_.fetch_sub(span->numPages, std::memory_order_relaxed);
+    }
+    else
+    {
+        arena.normalSpans.remove(span);
+        normalFreePages_.fetch_sub(span->numPages, std::memory_order_relaxed);
+    }
+    freeSpans_.fetch_sub(1, std::memory_order_relaxed);
+    span->isFree = false;
+}
 
-    // 查找合适的空闲span
-    // lower_bound函数返回第一个大于等于numPages的元素的迭代器
-    //可能你要4页的span，如果有4页的，就返回指向4页的span的迭代器，否则就可能指向5页的span迭代器
-    auto it = freeSpans_.lower_bound(numPages);
+void PageCache::FreeIndex::insert(Span* span)
+{
+    span->prev = nullptr;
+    span->next = nullptr;
+
+    if (span->numPages < MAX_BUCKET_PAGES)
+    {
+        // 头插到对应页数的桶，并置位
+        Span*& head = buckets[span->numPages];
+        span->next = head;
+        if (head) head->prev = span;
+        head = span;
+        bitmap[span->numPages / 64] |= uint64_t(1) << (span->numPages % 64);
+    }
+    else
+    {
+        large.insert(span);
+    }
+}
 
-    //如果有空闲的span可以分配
-    if (it != freeSpans_.end())
+void PageCache::FreeIndex::remove(Span* span)
+{
+    if (span->numPages < MAX_BUCKET_PAGES)
     {
-        //把头拿出来
-        Span* span = it->second;
+        // 双向链表，O(1) 摘除；桶空了就清位
+        if (span->prev) span->prev->next = span->next;
+        else buckets[span->numPages] = span->next;
+        if (span->next) span->next->prev = span->prev;
 
-        // 将取出的span从原有的空闲链表freeSpans_[it->first]中移除
-        //如果span下面还有下一个该页数的span，那下一个变成头，我取第一个走
-        if (span->next)
+        if (!buckets[span->numPages])
         {
-            freeSpans_[it->first] = span->next;
+            bitmap[span->numPages / 64] &= ~(uint64_t(1) << (span->numPages % 64));
         }
-        else
+    }
+    else
+    {
+        large.erase(span);
+    }
+
+    span->prev = nullptr;
+    span->next = nullptr;
+}
+
+PageCache::Span* PageCache::FreeIndex::find(size_t numPages) const
+{
+    if (numPages < MAX_BUCKET_PAGES)
+    {
+        // 从第 numPages 位开始找第一个非空桶
+        size_t word = numPages / 64;
+        uint64_t bits = bitmap[word] & (~uint64_t(0) << (numPages % 64));
+        while (true)
         {
-            //如果只有这一个结点，那这条链就该移除了
-            freeSpans_.erase(it);
+            if (bits)
+            {
+                return buckets[word * 64 + __builtin_ctzll(bits)];
+            }
+            if (++word == BITMAP_WORDS) break;
+            bits = bitmap[word];
         }
+    }
+
+    // 桶里没有，去大span集合里找页数 >= numPages 的最小者（同页数取低地址）
+    auto it = large.lower_bound(numPages);
+    return it != large.end() ? *it : nullptr;
+}
 
-        // 如果span大于需要的numPages则进行分割
-        if (span->numPages > numPages) 
+template <typename Fn>
+void PageCache::FreeIndex::drain(Fn&& fn)
+{
+    for (size_t pages = 1; pages < MAX_BUCKET_PAGES; ++pages)
+    {
+        for (Span* span = buckets[pages]; span; )
         {
-            //这个newspan就是要切走的页
-            Span* newSpan = new Span;
-            newSpan->pageAddr = static_cast<char*>(span->pageAddr) + 
-                                numPages * PAGE_SIZE;
-            newSpan->numPages = span->numPages - numPages;
-            newSpan->next = nullptr;
-
-            // 好引用，将超出部分放回空闲Span*列表头部
-            auto& list = freeSpans_[newSpan->numPages];
-            //插到头上
-            newSpan->next = list;
-            //变成头
-            list = newSpan;
-
-            //spanMap_[span->pageAddr] = span;
-            spanMap_[newSpan->pageAddr] = newSpan;
-            span->numPages = numPages;
+            Span* next = span->next;
+            fn(span);
+            span = next;
         }
+        buckets[pages] = nullptr;
+    }
+    bitmap.fill(0);
 
-        // 记录span信息用于回收
-        spanMap_[span->pageAddr] = span;
-        return span->pageAddr;
+    for (Span* span : large)
+    {
+        fn(span);
     }
+    large.clear();
+}
 
-    // 没有合适的span，向系统申请，只申请刚好够numPages页
-    void* memory = systemAlloc(numPages);
-    if (!memory) return nullptr;
+void PageCache::registerFreeSpan(Span* span)
+{
+    size_t first = PageMap<Span>::pageIdOf(span->pageAddr);
+    pageMap_.set(first, span);
+    if (span->numPages > 1)
+    {
+        pageMap_.set(first + span->numPages - 1, span);
+    }
+}
 
-    // 创建新的span
-    Span* span = new Span;
-    span->pageAddr = memory;
-    span->numPages = numPages;
-    span->next = nullptr;
 
-    // 记录span信息用于回收
-    spanMap_[memory] = span;
-    return memory;
+void* PageCache::systemAlloc(Arena& arena, size_t& numPages)
+{
+    if (!hugePageMode())
+    {
+        size_t size = numPages * PAGE_SIZE;
+
+        // 使用mmap分配内存
+        void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr == MAP_FAILED) return nullptr;
+        mappedBytes_.fetch_add(size, std::memory_order_relaxed);
+
+        // 清零内存
+        //memset(ptr, 0, size);
+        return ptr;
+    }
+
+    // 大页模式：取整到 2MB 的整数倍，多映射一个大页的余量，再把首尾没对齐的部分还回去
+    size_t size = (numPages * PAGE_SIZE + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    char* raw = static_cast<char*>(mmap(nullptr, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (raw == MAP_FAILED) return nullptr;
+
+    char* aligned = reinterpret_cast<char*>(
+        (reinterpret_cast<std::uintptr_t>(raw) + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+    if (aligned > raw) munmap(raw, aligned - raw);
+    size_t tail = (raw + size + HUGE_PAGE_SIZE) - (aligned + size);
+    if (tail > 0) munmap(aligned + size, tail);
+
+#ifdef MADV_HUGEPAGE
+    madvise(aligned, size, MADV_HUGEPAGE);
+#endif
+
+    numPages = size / PAGE_SIZE;
+    mappedBytes_.fetch_add(size, std::memory_order_relaxed);
+    addHugeRegion(arena, aligned, numPages);
+    return aligned;
+}
+
+void PageCache::addHugeRegion(Arena& arena, void* base, size_t numPages)
+{
+    auto& hugeRegions = arena.hugeRegions;
+    size_t first = PageMap<Span>::pageIdOf(base);
+
+    // 和后面紧挨着的区域合并
+    auto next = hugeRegions.find(first + numPages);
+    if (next != hugeRegions.end())
+    {
+        numPages += next->second;
+        hugeRegions.erase(next);
+    }
+
+    // 和前面紧挨着的区域合并
+    auto it = hugeRegions.lower_bound(first);
+    if (it != hugeRegions.begin())
+    {
+        auto prev = std::prev(it);
+        if (prev->first + prev->second == first)
+        {
+            prev->second += numPages;
+            return;
+        }
+    }
+    hugeRegions[first] = numPages;
+}
+
+PageCache::HugePageStats PageCache::hugePageStats()
+{
+    HugePageStats stats{};
+
+    // 每个大页里：已分配出去的页数、已还给系统的页数
+    size_t inUse = 0, released = 0;
+    auto finishHugePage = [&] {
+        ++stats.total;
+        if (inUse == HUGE_PAGE_PAGES) ++stats.full;
+        else if (inUse > 0) ++stats.partial;
+        else if (released == 0) ++stats.free;
+        if (released == HUGE_PAGE_PAGES) ++stats.released;
+        else if (released > 0) ++stats.broken;
+        inUse = released = 0;
+    };
+
+    // 区域里切出来的span都属于这个 arena，持有它的锁就能安全地看这些span
+    for (Arena& arena : arenas_)
+    {
+        std::lock_guard<std::mutex> lock(arena.mutex);
+        for (const auto& region : arena.hugeRegions)
+        {
+            // 从区域起点按span逐个往后跳：每次落脚的页都是span的首页，页表里一定是最新的登记
+            const size_t end = region.first + region.second;
+            size_t page = region.first;
+            while (page < end)
+            {
+                Span* span = pageMap_.get(page);
+                size_t len = 1;
+                bool spanInUse = false, spanReleased = false;
+                if (span && PageMap<Span>::pageIdOf(span->pageAddr) == page)
+                {
+                    len = span->numPages;
+                    spanInUse = !span->isFree;
+                    spanReleased = span->isFree && span->released;
+                }
+
+                // 把 [page, page + len) 摊到各个大页上
+                const size_t spanEnd = std::min(page + len, end);
+                while (page < spanEnd)
+                {
+                    size_t hugeEnd = (page / HUGE_PAGE_PAGES + 1) * HUGE_PAGE_PAGES;
+                    size_t chunk = std::min(hugeEnd, spanEnd) - page;
+                    if (spanInUse) inUse += chunk;
+                    if (spanReleased) released += chunk;
+                    page += chunk;
+                    if (page == hugeEnd) finishHugePage();
+                }
+            }
+        }
+    }
+    return stats;
 }
 
+void PageCache::deallocateSpan(Span* span)
+{
+    // 不是PageCache分配出去的span，直接返回
+    if (!span || mapObjectToSpan(span->pageAddr) != span) return;
+    const uint8_t owner = span->arena.load(std::memory_order_relaxed);
+    if (owner == 0) return;
+
+    std::lock_guard<std::mutex> lock(arenas_[owner - 1].mutex);
+    if (span->isFree) return;
+
+    pagesInUse_.fetch_sub(span->numPages, std::memory_order_relaxed);
+    spansInUse_.fetch_sub(1, std::memory_order_relaxed);
+
+    // 清掉 CentralCache 留下的切分信息
+    span->prev = nullptr;
+    span->sizeClass = 0;
+    span->objSize = 0;
+    span->useCount = 0;
+    span->freeList = nullptr;
+    span->isLarge = false;
+    span->sampled = false;
+    span->released = false;
+    span->freeSince = nowMs();
+
+    // 合并完成后，放回空闲索引（同时更新首尾页的登记）
+    insertFreeSpan(mergeNeighbors(span));
+}
 
-void* PageCache::systemAlloc(size_t numPages)
+bool PageCache::resizeSpan(Span* span, size_t numPages)
 {
-    size_t size = numPages * PAGE_SIZE;
+    std::lock_guard<std::mutex> lock(arenaOf(span).mutex);
+
+    const size_t first = PageMap<Span>::pageIdOf(span->pageAddr);
+    const uint8_t owner = span->arena.load(std::memory_order_relaxed);
+    if (numPages == span->numPages) return true;
+
+    if (numPages < span->numPages)
+    {
+        // 缩小：尾部切成空闲span，能和后面的空闲span合并就合并
+        Span* rest = newSpan(owner - 1);
+        if (!rest) return false;
+        rest->pageAddr = static_cast<char*>(span->pageAddr) + numPages * PAGE_SIZE;
+        rest->numPages = span->numPages - numPages;
+        rest->freeSince = nowMs();
+        span->numPages = numPages;
+        pagesInUse_.fetch_sub(rest->numPages, std::memory_order_relaxed);
+        insertFreeSpan(mergeNeighbors(rest));
+        return true;
+    }
+
+    // 变大：后邻必须是同一 arena、首页紧挨着、页数够的空闲span（和合并一样，先比归属再看别的字段）
+    const size_t extra = numPages - span->numPages;
+    Span* next = pageMap_.get(first + span->numPages);
+    if (!next || next->arena.load(std::memory_order_relaxed) != owner || !next->isFree ||
+        next->pageAddr != static_cast<char*>(span->pageAddr) + span->numPages * PAGE_SIZE ||
+        next->numPages < extra)
+    {
+        return false;
+    }
 
-    // 使用mmap分配内存
-    void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
-                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    if (ptr == MAP_FAILED) return nullptr;
+    removeFreeSpan(next);
+    if (next->numPages > extra)
+    {
+        // 从后邻的低地址切走 extra 页，剩下的放回去
+        next->pageAddr = static_cast<char*>(next->pageAddr) + extra * PAGE_SIZE;
+        next->numPages -= extra;
+        insertFreeSpan(next);
+    }
+    else
+    {
+        deleteSpan(next);
+    }
 
-    // 清零内存
-    //memset(ptr, 0, size);
-    return ptr;
+    pageMap_.setRange(first + span->numPages, extra, span);
+    span->numPages = numPages;
+    pagesInUse_.fetch_add(extra, std::memory_order_relaxed);
+    return true;
 }
 
-void PageCache::deallocateSpan(void* ptr, size_t numPages)
+PageCache::Span* PageCache::mergeNeighbors(Span* span)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
+    // 只和同一 arena、状态相同的邻居合并：常驻的和常驻的，已还给系统的和已还给系统的
+    // 邻居可能是别的 arena 的span，先比归属，是自己 arena 的才由本锁保护，才能看别的字段
+    const uint8_t owner = span->arena.load(std::memory_order_relaxed);
+    auto mergeable = [span, owner](Span* other) {
+        return other && other->arena.load(std::memory_order_relaxed) == owner &&
+               other->isFree && other->released == span->released;
+    };
+
+    // 向后合并：span | nextSpan  ->  span
+    // 后邻的首页、前邻的尾页一定登记在页表里，直接 O(1) 查到，O(1) 从空闲索引里摘掉
+    size_t firstPage = PageMap<Span>::pageIdOf(span->pageAddr);
+    Span* nextSpan = pageMap_.get(firstPage + span->numPages);
+    if (mergeable(nextSpan) && nextSpan->pageAddr ==
+        static_cast<char*>(span->pageAddr) + span->numPages * PAGE_SIZE)
+    {
+        removeFreeSpan(nextSpan);
+        span->numPages += nextSpan->numPages;  // 扩大当前 span
+        span->freeSince = std::max(span->freeSince, nextSpan->freeSince);
+        deleteSpan(nextSpan);                  // 释放被吸收的元数据
+    }
+
+    // 向前合并：prevSpan | span  ->  prevSpan
+    Span* prevSpan = firstPage > 0 ? pageMap_.get(firstPage - 1) : nullptr;
+    if (mergeable(prevSpan) && static_cast<char*>(prevSpan->pageAddr) +
+        prevSpan->numPages * PAGE_SIZE == span->pageAddr)
+    {
+        removeFreeSpan(prevSpan);
+        prevSpan->numPages += span->numPages;  // 扩大前邻
+        prevSpan->freeSince = std::max(span->freeSince, prevSpan->freeSince);
+        deleteSpan(span);                      // 释放被吸收的元数据
+        span = prevSpan;                       // 锚点改为合并后的前邻
+    }
 
-    // 查找对应的span，没找到代表不是PageCache分配的内存，直接返回
-    auto it = spanMap_.find(ptr);
-    if (it == spanMap_.end()) return;
+    return span;
+}
 
-    Span* span = it->second;
+size_t PageCache::releaseSpan(Span* span, bool useMadvFree)
+{
+    removeFreeSpan(span);
 
-    // 从空闲链表中摘掉指定 span；成功返回 true，失败(不在空闲)返回 false
-    auto removeFromFreeList = [&](Span* s) -> bool {
-        auto listIt = freeSpans_.find(s->numPages);
-        if (listIt == freeSpans_.end()) return false; // 没这条链，肯定不在空闲
-        Span*& head = listIt->second;
-        if (!head) return false;
+    if (hugePageMode())
+    {
+        // 只还整块对齐的 2MB，头尾的零头切成常驻的空闲span，避免把还在用的大页打散
+        size_t first = PageMap<Span>::pageIdOf(span->pageAddr);
+        size_t last  = first + span->numPages;
+        size_t alignedFirst = (first + HUGE_PAGE_PAGES - 1) / HUGE_PAGE_PAGES * HUGE_PAGE_PAGES;
+        size_t alignedLast  = last / HUGE_PAGE_PAGES * HUGE_PAGE_PAGES;
+        if (alignedFirst >= alignedLast)
+        {
+            insertFreeSpan(span);
+            return 0;
+        }
 
-        if (head == s) {                 // 头结点
-            head = s->next;
-            s->next = nullptr;           // 清理 next，避免脏指针
+        auto splitOff = [this, span](size_t page, size_t pages) {
+            Span* piece = newSpan(span->arena.load(std::memory_order_relaxed) - 1);
+            if (!piece) return false;
+            piece->pageAddr = reinterpret_cast<void*>(page << PAGE_SHIFT);
+            piece->numPages = pages;
+            piece->freeSince = span->freeSince;
+            insertFreeSpan(piece);
             return true;
+        };
+        if (alignedFirst > first && !splitOff(first, alignedFirst - first))
+        {
+            insertFreeSpan(span);
+            return 0;
         }
-        for (Span* p = head; p->next; p = p->next) { // 中间/尾结点
-            if (p->next == s) {
-                p->next = s->next;
-                s->next = nullptr;       // 清理 next
-                return true;
-            }
+        if (last > alignedLast && !splitOff(alignedLast, last - alignedLast))
+        {
+            // 尾巴切不出来就连同尾巴一起还
+            alignedLast = last;
         }
-        return false;                    // 不在空闲链（说明正在被使用）
-    };
+        span->pageAddr = reinterpret_cast<void*>(alignedFirst << PAGE_SHIFT);
+        span->numPages = alignedLast - alignedFirst;
+    }
+
+    size_t bytes = span->numPages * PAGE_SIZE;
+    int advice = MADV_DONTNEED;
+#ifdef MADV_FREE
+    if (useMadvFree) advice = MADV_FREE;
+#endif
+    // 老内核不支持 MADV_FREE 时退回 MADV_DONTNEED
+    if (madvise(span->pageAddr, bytes, advice) != 0 && advice != MADV_DONTNEED)
+    {
+        madvise(span->pageAddr, bytes, MADV_DONTNEED);
+    }
+
+    totalReleasedBytes_.fetch_add(bytes, std::memory_order_relaxed);
+    releaseCount_.fetch_add(1, std::memory_order_relaxed);
+
+    span->released = true;
+    insertFreeSpan(mergeNeighbors(span));
+    return bytes;
+}
+
+size_t PageCache::releaseFreeSpans(size_t idleMs, size_t keepBytes, bool useMadvFree)
+{
+    // 逐个 arena 加锁回收，保留量按所有 arena 的常驻空闲页合计
+    const size_t keepPages = keepBytes / PAGE_SIZE;
+    size_t releasedBytes = 0;
+    for (Arena& arena : arenas_)
+    {
+        if (normalFreePages_.load(std::memory_order_relaxed) <= keepPages) break;
 
-    // 反复尝试向后、向前合并，直到不能再合并
-    bool merged;
-    do {
-        merged = false;
+        std::lock_guard<std::mutex> lock(arena.mutex);
+        releasedBytes += releaseArena(arena, idleMs, keepPages, useMadvFree);
+    }
+    return releasedBytes;
+}
+
+size_t PageCache::releaseArena(Arena& arena, size_t idleMs, size_t keepPages, bool useMadvFree)
+{
+    const uint64_t now = nowMs();
+    size_t releasedBytes = 0;
+
+    auto shouldStop = [&] {
+        return normalFreePages_.load(std::memory_order_relaxed) <= keepPages;
+    };
+    auto idle = [&](Span* span) {
+        return now - span->freeSince >= idleMs;
+    };
+    // 大页模式下，盖不住一个完整对齐大页的span不还
+    auto releasable = [&](Span* span) {
+        if (!hugePageMode()) return true;
+        size_t first = PageMap<Span>::pageIdOf(span->pageAddr);
+        size_t alignedFirst = (first + HUGE_PAGE_PAGES - 1) / HUGE_PAGE_PAGES * HUGE_PAGE_PAGES;
+        return alignedFirst + HUGE_PAGE_PAGES <= first + span->numPages;
+    };
 
-        // ===== 向后合并：span | nextSpan  ->  span =====
+    // 先还大的，系统调用次数少；releaseSpan 只会把当前span从常驻索引里摘掉，遍历是安全的
+    auto& large = arena.normalSpans.large;
+    auto it = large.end();
+    while (it != large.begin() && !shouldStop())
+    {
+        auto cur = std::prev(it);
+        Span* span = *cur;
+        if (!idle(span) || !releasable(span))
         {
-            void* nextAddr = static_cast<char*>(span->pageAddr) + span->numPages * PAGE_SIZE;
-            auto nextIt = spanMap_.find(nextAddr);
-            if (nextIt != spanMap_.end()) {
-                Span* nextSpan = nextIt->second;
-
-                // 只和“空闲”的后邻合并
-                if (removeFromFreeList(nextSpan)) {
-                    span->numPages += nextSpan->numPages;  // 扩大当前 span
-                    spanMap_.erase(nextIt);                // 移除后邻 begin 映射
-                    delete nextSpan;                       // 释放被吸收的元数据
-                    merged = true;
-                }
-            }
+            it = cur;
+            continue;
         }
 
-        // ===== 向前合并：prevSpan | span  ->  prevSpan =====
+        // 元数据不够切不出头部时span会原样插回当前位置，这一轮就到此为止
+        size_t bytes = releaseSpan(span, useMadvFree);
+        if (bytes == 0) break;
+        releasedBytes += bytes;
+    }
+
+    for (size_t pages = FreeIndex::MAX_BUCKET_PAGES - 1; pages > 0 && !shouldStop(); --pages)
+    {
+        for (Span* span = arena.normalSpans.buckets[pages]; span && !shouldStop(); )
         {
-            auto currIt = spanMap_.find(span->pageAddr);
-            if (currIt != spanMap_.begin()) {
-                auto prevIt = std::prev(currIt);
-                Span* prev = prevIt->second;
-
-                char* prevEnd = static_cast<char*>(prev->pageAddr) + prev->numPages * PAGE_SIZE;
-                if (prevEnd == span->pageAddr) {
-                    // 只和“空闲”的前邻合并
-                    if (removeFromFreeList(prev)) {
-                        Span* cur = span;                  // 当前 span 被吸收
-                        prev->numPages += cur->numPages;   // 扩大前邻
-                        spanMap_.erase(cur->pageAddr);     // 移除当前 begin 映射
-                        delete cur;                        // 释放被吸收的元数据
-                        span = prev;                       // 锚点改为合并后的前邻
-                        merged = true;
-                    }
-                }
+            Span* next = span->next;
+            if (idle(span) && releasable(span))
+            {
+                releasedBytes += releaseSpan(span, useMadvFree);
             }
+            span = next;
         }
+    }
+
+    return releasedBytes;
+}
+
+PageCache::ReleaseStats PageCache::releaseStats() const
+{
+    ReleaseStats stats;
+    size_t released = releasedFreePages_.load(std::memory_order_relaxed);
+    stats.freeBytes          = (normalFreePages_.load(std::memory_order_relaxed) + released) * PAGE_SIZE;
+    stats.releasedBytes      = released * PAGE_SIZE;
+    stats.totalReleasedBytes = totalReleasedBytes_.load(std::memory_order_relaxed);
+    stats.releaseCount       = releaseCount_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+PageCache::SpanStats PageCache::spanStats() const
+{
+    SpanStats stats;
+    size_t released = releasedFreePages_.load(std::memory_order_relaxed);
+    stats.mappedBytes   = mappedBytes_.load(std::memory_order_relaxed);
+    stats.spansInUse    = spansInUse_.load(std::memory_order_relaxed);
+    stats.pagesInUse    = pagesInUse_.load(std::memory_order_relaxed);
+    stats.freeSpans     = freeSpans_.load(std::memory_order_relaxed);
+    stats.freePages     = normalFreePages_.load(std::memory_order_relaxed) + released;
+    stats.releasedPages = released;
+    return stats;
+}
+
+uint64_t PageCache::nowMs()
+{
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void PageCache::startScavenger(const ScavengerOptions& options)
+{
+    stopScavenger();
+
+    std::lock_guard<std::mutex> lock(scavengerMutex_);
+    scavengerStop_ = false;
+    scavenger_ = std::thread(&PageCache::scavengerLoop, this, options);
+}
+
+void PageCache::stopScavenger()
+{
+    {
+        std::lock_guard<std::mutex> lock(scavengerMutex_);
+        if (!scavenger_.joinable()) return;
+        scavengerStop_ = true;
+    }
+    scavengerCv_.notify_all();
+    scavenger_.join();
+}
 
-    } while (merged);
+void PageCache::scavengerLoop(ScavengerOptions options)
+{
+    std::unique_lock<std::mutex> lock(scavengerMutex_);
+    while (!scavengerStop_)
+    {
+        scavengerCv_.wait_for(lock, std::chrono::milliseconds(options.intervalMs));
+        if (scavengerStop_) break;
 
-    // 合并完成后，把大 span 头插到对应页数的空闲链
-    span->next = freeSpans_[span->numPages];
-    freeSpans_[span->numPages] = span;
+        lock.unlock();
+        releaseFreeSpans(options.idleMs, options.headroomBytes, options.useMadvFree);
+        lock.lock();
+    }
 }
 
 
@@ -176,13 +697,26 @@ PageCache::~PageCache() {
 }
 
 void PageCache::shutdown() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    for (auto& kv : spanMap_) {
-        delete kv.second;
-    }
-
-    spanMap_.clear();
+    stopScavenger();
+
+    // 已分配出去的span还被 CentralCache 引用着，不能动；空闲span连同页一起还给系统
+    auto release = [this](Span* span) {
+        pageMap_.setRange(PageMap<Span>::pageIdOf(span->pageAddr), span->numPages, nullptr);
+        munmap(span->pageAddr, span->numPages * PAGE_SIZE);
+        mappedBytes_.fetch_sub(span->numPages * PAGE_SIZE, std::memory_order_relaxed);
+        if (!span->released) {
+            totalReleasedBytes_.fetch_add(span->numPages * PAGE_SIZE, std::memory_order_relaxed);
+        }
+        deleteSpan(span);
+    };
 
-    // freeSpans_ 只是引用 span，不要重复 delete；清指针即可
-    freeSpans_.clear();
+    for (Arena& arena : arenas_)
+    {
+        std::lock_guard<std::mutex> lock(arena.mutex);
+        arena.normalSpans.drain(release);
+        arena.releasedSpans.drain(release);
+    }
+    normalFreePages_.store(0, std::memory_order_relaxed);
+    releasedFreePages_.store(0, std::memory_order_relaxed);
+    freeSpans_.store(0, std::memory_order_relaxed);
 }
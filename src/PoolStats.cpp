@@ -0,0 +1,89 @@
+#include "PoolStats.h"
+#include "StringFormat.h"
+
+namespace
+{
+    using detail::appendf;
+
+    double mib(size_t bytes)
+    {
+        return bytes / (1024.0 * 1024.0);
+    }
+
+    void appendBytes(std::string& out, const char* name, size_t bytes)
+    {
+        appendf(out, "%-28s %14zu (%10.1f MiB)\n", name, bytes, mib(bytes));
+    }
+}
+
+std::string PoolStats::toText() const
+{
+    std::string out;
+    out.reserve(4096);
+
+    out += "------------------------------------------------\n";
+    out += "MemoryPool stats\n";
+    out += "------------------------------------------------\n";
+    appendBytes(out, "Bytes mapped from OS", mappedBytes);
+    appendBytes(out, "Bytes released to OS", totalReleasedBytes);
+    appendf(out, "%-28s %14zu\n", "Release calls", releaseCount);
+    out += "\n";
+    appendBytes(out, "Thread cache", threadCacheBytes);
+    appendBytes(out, "Per-CPU cache", cpuCacheBytes);
+    appendBytes(out, "Transfer cache", transferCacheBytes);
+    appendBytes(out, "Central cache", centralCacheBytes);
+    appendBytes(out, "Page heap free", pageHeapFreeBytes);
+    appendBytes(out, "Page heap released", pageHeapReleasedBytes);
+    appendBytes(out, "Large object cache", largeCacheBytes);
+    appendBytes(out, "Large objects in use", largeInUseBytes);
+    appendf(out, "%-28s %14zu (%zu cache hits)\n", "Large allocations", largeAllocs, largeCacheHits);
+    out += "\n";
+    appendf(out, "%-28s %14zu (%zu pages)\n", "Spans in use", spansInUse, pagesInUse);
+    appendf(out, "%-28s %14zu (%zu pages)\n", "Free spans", freeSpans, freePages);
+    out += "\n";
+
+    appendf(out, "%5s %7s %12s %12s %9s %9s %9s %9s %9s %6s\n",
+            "class", "size", "allocs", "frees", "refills", "spills",
+            "thread", "transfer", "central", "spans");
+    for (size_t index = 0; index < classes.size(); ++index)
+    {
+        const SizeClassStats& c = classes[index];
+        if (!c.allocs && !c.refills && !c.spans && !c.transferBlocks) continue;
+        appendf(out, "%5zu %7zu %12zu %12zu %9zu %9zu %9zu %9zu %9zu %6zu\n",
+                index, c.size, c.allocs, c.frees, c.refills, c.spills,
+                c.threadCacheBlocks, c.transferBlocks, c.centralFreeBlocks, c.spans);
+    }
+    return out;
+}
+
+std::string PoolStats::toJson() const
+{
+    std::string out;
+    out.reserve(16384);
+
+    out += "{";
+    appendf(out, "\"os\":{\"mapped_bytes\":%zu,\"released_bytes\":%zu,\"release_count\":%zu},",
+            mappedBytes, totalReleasedBytes, releaseCount);
+    appendf(out, "\"tiers\":{\"thread_cache_bytes\":%zu,\"cpu_cache_bytes\":%zu,\"transfer_cache_bytes\":%zu,",
+            threadCacheBytes, cpuCacheBytes, transferCacheBytes);
+    appendf(out, "\"central_cache_bytes\":%zu,\"page_heap_free_bytes\":%zu,\"page_heap_released_bytes\":%zu,",
+            centralCacheBytes, pageHeapFreeBytes, pageHeapReleasedBytes);
+    appendf(out, "\"large_cache_bytes\":%zu},", largeCacheBytes);
+    appendf(out, "\"large\":{\"in_use_bytes\":%zu,\"allocs\":%zu,\"cache_hits\":%zu},",
+            largeInUseBytes, largeAllocs, largeCacheHits);
+    appendf(out, "\"spans\":{\"in_use\":%zu,\"pages_in_use\":%zu,\"free\":%zu,\"free_pages\":%zu},",
+            spansInUse, pagesInUse, freeSpans, freePages);
+
+    out += "\"classes\":[";
+    for (size_t index = 0; index < classes.size(); ++index)
+    {
+        const SizeClassStats& c = classes[index];
+        if (index) out += ",";
+        appendf(out, "{\"size\":%zu,\"allocs\":%zu,\"frees\":%zu,\"refills\":%zu,\"spills\":%zu,",
+                c.size, c.allocs, c.frees, c.refills, c.spills);
+        appendf(out, "\"thread_cache_blocks\":%zu,\"transfer_blocks\":%zu,\"central_free_blocks\":%zu,\"spans\":%zu}",
+                c.threadCacheBlocks, c.transferBlocks, c.centralFreeBlocks, c.spans);
+    }
+    out += "]}";
+    return out;
+}
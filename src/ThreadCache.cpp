@@ -2,9 +2,328 @@
 #include <iostream>
 #include "PageCache.h"
 #include "CentralCache.h"
+#include "LargeCache.h"
+#include "MetaArena.h"
+#include <pthread.h>
+#include <cassert>
+#include <ctime>
 
-//构造函数
-ThreadCache::ThreadCache():freeList_{},freeListSize_{} {}
+namespace
+{
+    // 所有线程的 ThreadCache 都从这里切
+    MetaArena<ThreadCache> threadCacheArena;
+
+    // 退出线程暂存下来的 ThreadCache，新线程优先接手，省掉一轮从中心缓存的预热
+    SpinLock     parkedLock;
+    ThreadCache* parkedHead  = nullptr;
+    size_t       parkedCount = 0;
+    std::atomic<size_t> maxParked{0};
+
+    // 所有活着（含暂存）的 ThreadCache 登记在一条双向链表上，全局缓存预算在它们之间分配
+    SpinLock     registryLock;
+    ThreadCache* registryHead   = nullptr;
+    ThreadCache* stealCursor    = nullptr; // 轮流偷预算的下一个目标
+    size_t       numCaches      = 0;
+    size_t       totalLimit     = 32 * 1024 * 1024; // 所有线程缓存加起来的上限
+    size_t       unclaimedBytes = 32 * 1024 * 1024; // 还没分给任何线程的预算
+
+    // 已经注销的 ThreadCache 留下的每档分配/释放次数
+    std::array<size_t, FREE_LIST_SIZE> retiredAllocs{};
+    std::array<size_t, FREE_LIST_SIZE> retiredFrees{};
+
+    // 只用来判断闲置，精度到几毫秒就够
+    uint64_t nowMs()
+    {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        return uint64_t(ts.tv_sec) * 1000 + uint64_t(ts.tv_nsec) / 1000000;
+    }
+}
+
+void ThreadCache::setMaxParkedCaches(size_t limit)
+{
+    maxParked.store(limit, std::memory_order_relaxed);
+
+    // 调小上限时，把多出来的暂存缓存清空回收
+    while (true)
+    {
+        ThreadCache* victim = nullptr;
+        {
+            std::lock_guard<SpinLock> guard(parkedLock);
+            if (parkedCount > limit)
+            {
+                victim = parkedHead;
+                parkedHead = victim->nextParked_;
+                --parkedCount;
+            }
+        }
+        if (!victim) break;
+        retire(victim);
+    }
+}
+
+void ThreadCache::retire(ThreadCache* cache)
+{
+    cache->releaseAll();
+    cache->unregisterCache();
+    cache->~ThreadCache();
+    threadCacheArena.deallocate(cache);
+}
+
+void ThreadCache::registerCache()
+{
+    std::lock_guard<SpinLock> guard(registryLock);
+
+    // 先拿最低额度，公共预算不够也照给：不能让新线程连缓存都没有，多出来的靠偷回来抵
+    maxSize_.store(MIN_CACHE_BYTES, std::memory_order_relaxed);
+    lastActive_.store(nowMs(), std::memory_order_relaxed);
+
+    regPrev_ = nullptr;
+    regNext_ = registryHead;
+    if (registryHead) registryHead->regPrev_ = this;
+    registryHead = this;
+    ++numCaches;
+    refreshUnclaimed();
+}
+
+void ThreadCache::refreshUnclaimed()
+{
+    // 公共池不单独记账，每次从各线程占着的现算：超额给出去的最低额度不会在线程退出时多还回来
+    size_t charged = 0;
+    for (ThreadCache* c = registryHead; c; c = c->regNext_)
+    {
+        charged += c->chargedBytes();
+    }
+    unclaimedBytes = totalLimit > charged ? totalLimit - charged : 0;
+}
+
+void ThreadCache::unregisterCache()
+{
+    std::lock_guard<SpinLock> guard(registryLock);
+
+    // 计数并入全局，线程退出后统计不丢
+    for (size_t index = 0; index < FREE_LIST_SIZE; ++index)
+    {
+        ClassStats stats{};
+        addClassStats(index, stats);
+        retiredAllocs[index] += stats.allocs;
+        retiredFrees[index]  += stats.frees;
+    }
+
+    if (stealCursor == this) stealCursor = regNext_;
+    if (regPrev_) regPrev_->regNext_ = regNext_;
+    else registryHead = regNext_;
+    if (regNext_) regNext_->regPrev_ = regPrev_;
+    --numCaches;
+
+    // 额度交回公共池
+    refreshUnclaimed();
+}
+
+void ThreadCache::increaseBudget()
+{
+    std::lock_guard<SpinLock> guard(registryLock);
+
+    size_t current = maxSize_.load(std::memory_order_relaxed);
+    if (current >= MAX_CACHE_BYTES) return;
+
+    // 被收回额度的线程收缩以后，它让出来的才算进公共池
+    refreshUnclaimed();
+
+    // 公共预算还有就直接拿
+    if (unclaimedBytes >= STEAL_BYTES)
+    {
+        unclaimedBytes -= STEAL_BYTES;
+        maxSize_.store(current + STEAL_BYTES, std::memory_order_relaxed);
+        return;
+    }
+
+    // 否则从别的线程偷：先找闲置的，没有再轮流找额度还高于最低额度的
+    ThreadCache* victim = nullptr;
+    uint64_t idleBefore = nowMs() - IDLE_STEAL_MS;
+    for (ThreadCache* c = registryHead; c; c = c->regNext_)
+    {
+        if (c != this && c->maxSize_.load(std::memory_order_relaxed) > MIN_CACHE_BYTES &&
+            c->lastActive_.load(std::memory_order_relaxed) <= idleBefore)
+        {
+            victim = c;
+            break;
+        }
+    }
+    for (size_t i = 0; !victim && i < numCaches; ++i)
+    {
+        ThreadCache* c = stealCursor ? stealCursor : registryHead;
+        stealCursor = c->regNext_;
+        if (c != this && c->maxSize_.load(std::memory_order_relaxed) > MIN_CACHE_BYTES)
+        {
+            victim = c;
+        }
+    }
+    if (!victim) return;
+
+    // 被偷的线程下次释放时发现超了预算，自己把多出来的还给中心缓存
+    // 它上限之和以上的空余额度马上就能拿走；还占着块的那部分要等它收缩后经公共池再分
+    size_t victimSize = victim->maxSize_.load(std::memory_order_relaxed);
+    size_t victimCapacity = victim->capacity_.load(std::memory_order_relaxed);
+    size_t amount = std::min(STEAL_BYTES, victimSize - MIN_CACHE_BYTES);
+    size_t headroom = victimSize > victimCapacity ? victimSize - victimCapacity : 0;
+    victim->maxSize_.fetch_sub(amount, std::memory_order_relaxed);
+    victim->shrinkRequested_.store(true, std::memory_order_relaxed);
+    maxSize_.store(current + std::min(amount, headroom), std::memory_order_relaxed);
+}
+
+void ThreadCache::scavenge()
+{
+    // 先回到额度以内，再看看能不能从别处要点预算
+    shrinkToBudget();
+    lastActive_.store(nowMs(), std::memory_order_relaxed);
+    increaseBudget();
+}
+
+void ThreadCache::shrinkToBudget()
+{
+    // 每档上限减半，链上超出新上限的块还给中心缓存，直到回到额度以内
+    while (capacity_.load(std::memory_order_relaxed) > maxSize_.load(std::memory_order_relaxed))
+    {
+        for (size_t index = 0; index < FREE_LIST_SIZE; ++index)
+        {
+            FreeList& list = freeList_[index];
+            if (!list.maxLength) continue;
+            setMaxLength(index, list.maxLength / 2);
+            if (list.length > list.maxLength) returnToCentralCache(index, list.length - list.maxLength);
+        }
+    }
+}
+
+void ThreadCache::setTotalLimit(size_t bytes)
+{
+    std::lock_guard<SpinLock> guard(registryLock);
+
+    totalLimit = bytes;
+    // 已经分出去的超过新上限时公共预算为 0，后面线程要扩容只能互相偷，总量慢慢收回来
+    refreshUnclaimed();
+}
+
+size_t ThreadCache::shrinkIdleCaches(size_t idleMs)
+{
+    std::lock_guard<SpinLock> guard(registryLock);
+
+    uint64_t idleBefore = nowMs() - idleMs;
+    size_t reclaimed = 0;
+    for (ThreadCache* c = registryHead; c; c = c->regNext_)
+    {
+        size_t current = c->maxSize_.load(std::memory_order_relaxed);
+        if (current > MIN_CACHE_BYTES && c->lastActive_.load(std::memory_order_relaxed) <= idleBefore)
+        {
+            c->maxSize_.store(MIN_CACHE_BYTES, std::memory_order_relaxed);
+            c->shrinkRequested_.store(true, std::memory_order_relaxed);
+            reclaimed += current - MIN_CACHE_BYTES;
+        }
+    }
+    // 还占着块的部分要等那些线程收缩以后才回到公共池
+    refreshUnclaimed();
+    return reclaimed;
+}
+
+ThreadCache::BudgetStats ThreadCache::budgetStats()
+{
+    std::lock_guard<SpinLock> guard(registryLock);
+
+    refreshUnclaimed();
+    BudgetStats stats{};
+    stats.limit     = totalLimit;
+    stats.unclaimed = unclaimedBytes;
+    for (ThreadCache* c = registryHead; c; c = c->regNext_)
+    {
+        stats.claimed     += c->maxSize_.load(std::memory_order_relaxed);
+        stats.capacityBytes += c->capacity_.load(std::memory_order_relaxed);
+        for (size_t index = 0; index < FREE_LIST_SIZE; ++index)
+        {
+            stats.cachedBytes += __atomic_load_n(&c->freeList_[index].length, __ATOMIC_RELAXED) * SizeClass::classSize(index);
+        }
+        ++stats.caches;
+    }
+    return stats;
+}
+
+ThreadCache* ThreadCache::createInstance()
+{
+    // 用 pthread key 而不是 thread_local 对象挂线程退出回调，避免注册回调本身去调 malloc
+    static pthread_key_t key = [] {
+        pthread_key_t k;
+        pthread_key_create(&k, &ThreadCache::destroyInstance);
+        return k;
+    }();
+
+    ThreadCache* cache = nullptr;
+    {
+        // 先看看有没有退出线程留下的热缓存可以直接接手
+        std::lock_guard<SpinLock> guard(parkedLock);
+        if (parkedHead)
+        {
+            cache = parkedHead;
+            parkedHead = cache->nextParked_;
+            cache->nextParked_ = nullptr;
+            --parkedCount;
+        }
+    }
+
+    if (!cache)
+    {
+        void* mem = threadCacheArena.allocate();
+        if (!mem) return nullptr;
+        cache = new (mem) ThreadCache();
+        cache->registerCache();
+    }
+
+    tlsCache_ = cache;
+    pthread_setspecific(key, cache);
+    return cache;
+}
+
+void ThreadCache::destroyInstance(void* ptr)
+{
+    ThreadCache* cache = static_cast<ThreadCache*>(ptr);
+    tlsCache_ = nullptr;
+
+    // 可能要暂存：额度被收回过就先收缩，暂存着的缓存没有线程会来替它还块
+    if (maxParked.load(std::memory_order_relaxed))
+    {
+        cache->shrinkRequested_.store(false, std::memory_order_relaxed);
+        cache->shrinkToBudget();
+    }
+
+    {
+        // 还有暂存名额就整个挂起来，留给下一个新线程
+        std::lock_guard<SpinLock> guard(parkedLock);
+        if (parkedCount < maxParked.load(std::memory_order_relaxed))
+        {
+            cache->nextParked_ = parkedHead;
+            parkedHead = cache;
+            ++parkedCount;
+            return;
+        }
+    }
+
+    // 否则把缓存的内存块全部还给中心缓存、预算交回公共池，避免线程池反复换线程时内存一点点漏掉
+    retire(cache);
+}
+
+void ThreadCache::releaseAll()
+{
+    for (size_t index = 0; index < FREE_LIST_SIZE; ++index)
+    {
+        FreeList& list = freeList_[index];
+        if (list.head)
+        {
+            // 链表首尾和长度都是已知的，整条一次性交回
+            CentralCache::getInstance().returnRange(list.head, list.tail, list.length, index);
+            list.returned += list.length;
+            list.head = nullptr;
+            list.length = 0;
+        }
+    }
+}
 
 void* ThreadCache::allocate(size_t size)
 {
@@ -14,89 +333,170 @@ void* ThreadCache::allocate(size_t size)
         size = ALIGNMENT;
     }
 
-    //如果大于256KB，那就直接调用malloc分配
+    //如果大于256KB，按页交给 LargeCache
     if (size > MAX_BYTES)
     {
-        // 大对象直接从系统分配
-        return malloc(size);
+        return LargeCache::getInstance().allocate(size);
+    }
+
+    //找到对应的数组的位置，本地链为空时从中心缓存获取一批内存
+    return allocateClass(SizeClass::getIndex(size));
+}
+
+size_t ThreadCache::allocateBatch(size_t size, size_t n, void** out)
+{
+    if (size == 0)
+    {
+        size = ALIGNMENT;
+    }
+
+    // 大对象没有链表可以批量摘，逐个申请
+    if (size > MAX_BYTES)
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            out[i] = LargeCache::getInstance().allocate(size);
+            if (!out[i]) return i;
+        }
+        return n;
     }
 
-    //找到对应的数组的位置
     size_t index = SizeClass::getIndex(size);
+    FreeList& list = freeList_[index];
 
-    // 检查线程本地自由链表
-    // 如果 freeList_[index] 不为空，表示该链表中有可用内存块
-    void* ptr = freeList_[index];
-    if (ptr)
+    // 先把本地链上有的拿走
+    size_t got = 0;
+    while (got < n && list.head)
     {
-        // 头指向第二个内存块
-        freeList_[index] = *reinterpret_cast<void**>(ptr);
-        --freeListSize_[index];
-    }else {
-        ptr=fetchFromCentralCache(index);
+        out[got++] = list.head;
+        list.head = *reinterpret_cast<void**>(list.head);
+        --list.length;
+    }
+    if (got == n) return n;
+
+    // 调用方一次要 n 块，说明很快也会一次还 n 块：上限直接放宽到 n，下次整批还回来时留在本地
+    if (list.maxLength < n) setMaxLength(index, std::min(n, maxLengthLimit(index)));
+
+    // 差的部分一次向中心缓存要齐；中心缓存给的不会比要的多，全部交给调用方
+    misses_[index].fetch_add(1, std::memory_order_relaxed);
+    lastActive_.store(nowMs(), std::memory_order_relaxed);
+    while (got < n)
+    {
+        void* start = nullptr;
+        void* end = nullptr;
+        size_t actual = CentralCache::getInstance().fetchRange(index, n - got, start, end);
+        if (actual == 0) break;
+        assert(actual <= n - got);
+        list.fetched += actual;
+
+        void* obj = start;
+        for (size_t i = 0; i < actual; ++i)
+        {
+            out[got++] = obj;
+            obj = *reinterpret_cast<void**>(obj);
+        }
     }
 
-    // 如果线程本地自由链表为空，则从中心缓存获取一批内存
-    return ptr;
+    checkBudget();
+    return got;
 }
 
-//获取指定index的内存块，每个位置的内存块大小是固定的，8，16，24，32，……
-void* ThreadCache::fetchFromCentralCache(size_t index)
+void ThreadCache::deallocateBatch(void** ptrs, size_t n, size_t size)
 {
-    //获取要的内存块大小，index=0地方，需要的是字节数为8的内存块
-    size_t size = (index + 1) * ALIGNMENT;
+    if (n == 0) return;
 
-    // 根据对象内存大小计算批量获取的数量
-    size_t batchNum = getBatchNum(size);
+    if (size > MAX_BYTES)
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            deallocate(ptrs[i], size);
+        }
+        return;
+    }
 
-    // 从中心缓存批量获取内存
-    void* start = CentralCache::getInstance().fetchRange(index, batchNum);
-    if (!start) return nullptr;
+    size_t index = SizeClass::getIndex(size);
+    FreeList& list = freeList_[index];
 
-    // 统计实际返回的块数（最多 batchNum 个）
-    size_t actual = 0;
-    void* p = start;
-    while (p && actual < batchNum) {
-        ++actual;
-        p = *reinterpret_cast<void**>(p);
+    // 本地链上限以内的挂到本地链
+    size_t keep = list.maxLength > list.length ? std::min(n, list.maxLength - list.length) : 0;
+    for (size_t i = 0; i < keep; ++i)
+    {
+        if (!list.head) list.tail = ptrs[i];
+        *reinterpret_cast<void**>(ptrs[i]) = list.head;
+        list.head = ptrs[i];
     }
+    list.length += keep;
+    list.frees += n;
+    if (keep == n) return;
 
-    // 放回本地链 & 正确更新计数
-    if (actual > 1) {
-        freeList_[index] = *reinterpret_cast<void**>(start);
-        freeListSize_[index] += (actual - 1);
-    } else {
-        freeList_[index] = nullptr; // 只有1个块直接返回给用户
+    // 放不下的串成一条，一次还给中心缓存
+    for (size_t i = keep; i + 1 < n; ++i)
+    {
+        *reinterpret_cast<void**>(ptrs[i]) = ptrs[i + 1];
     }
+    *reinterpret_cast<void**>(ptrs[n - 1]) = nullptr;
 
-    return start;
+    overflows_[index].fetch_add(1, std::memory_order_relaxed);
+    lastActive_.store(nowMs(), std::memory_order_relaxed);
+    list.returned += n - keep;
+    CentralCache::getInstance().returnRange(ptrs[keep], ptrs[n - 1], n - keep, index);
 }
 
-// 计算批量获取内存块的数量
-size_t ThreadCache::getBatchNum(size_t size)
+//获取指定index的内存块，每个位置的内存块大小是固定的，16，32，……，128，144，160，……
+void* ThreadCache::fetchFromCentralCache(size_t index)
 {
-    // 基准：每次批量获取不超过4KB内存
-    // 根据对象大小设置合理的基准批量数
-    size_t baseNum;
-    if (size <= 32) baseNum = 128;    // 128 * 32 = 4KB
-    else if (size <= 64) baseNum = 64;  // 64 * 64 = 4KB
-    else if (size <= 128) baseNum = 32; // 32 * 128 = 4KB
-    else if (size <= 256) baseNum = 16;  // 16 * 256 = 4KB
-    else if (size <= 512) baseNum = 8;  // 8 * 512 = 4KB
-    else if (size <= 1024) baseNum = 4; // 4 * 1024 = 4KB
-    else baseNum = 2;                   // 大于1024的对象每次只从中心缓存取1个
+    // 这一档一批的块数，index=0 是 16 字节的块，一批 128 块
+    size_t batch = SizeClass::classBatch(index);
+    FreeList& list = freeList_[index];
+
+    // 慢启动：每次未命中把上限放宽一点，第 k 次未命中取 k 块，直到一整批；
+    // 之后上限按整批增长，让频繁使用这一档的线程本地能存得更多
+    if (list.maxLength < batch) setMaxLength(index, list.maxLength + 1);
+    else setMaxLength(index, std::min(list.maxLength + batch, maxLengthLimit(index)));
+    misses_[index].fetch_add(1, std::memory_order_relaxed);
+    lastActive_.store(nowMs(), std::memory_order_relaxed);
+
+    // 从中心缓存批量获取内存，首尾和块数一起带回来，不用再数一遍
+    void* start = nullptr;
+    void* end = nullptr;
+    size_t actual = CentralCache::getInstance().fetchRange(index, std::max<size_t>(1, std::min(list.maxLength, batch)), start, end);
+    if (actual == 0) return nullptr;
+    list.fetched += actual;
+
+    // 第一块直接给用户，剩下的挂到本地链（走到这里本地链一定是空的）
+    if (actual > 1) {
+        list.head = *reinterpret_cast<void**>(start);
+        list.tail = end;
+        list.length += (actual - 1);
+    } else {
+        list.head = nullptr;
+    }
 
-    return baseNum;
+    // 要的块数不超过上限，中心缓存也不会多给；万一多了，超出上限的马上还回去
+    if (list.length > list.maxLength)
+    {
+        returnToCentralCache(index, list.length - list.maxLength);
+    }
 
+    checkBudget();
+    return start;
 }
 
+size_t ThreadCache::maxLengthLimit(size_t index)
+{
+    size_t size  = SizeClass::classSize(index);
+    size_t limit = std::min(MAX_LIST_BYTES / size, MAX_LIST_LENGTH);
+    return std::max(limit, SizeClass::classBatch(index));
+}
 
 void ThreadCache::deallocate(void* ptr, size_t size)
 {
-    //大于256KB的，出门右拐
+    //大于256KB的，整个span还给 LargeCache
     if (size > MAX_BYTES)
     {
-        free(ptr);
+        PageCache::Span* span = PageCache::getInstance().mapObjectToSpan(ptr);
+        assert(span && span->isLarge);
+        LargeCache::getInstance().deallocate(span);
         return;
     }
 
@@ -105,79 +505,149 @@ void ThreadCache::deallocate(void* ptr, size_t size)
     freeToLocal(index, ptr);
 }
 
-// 判断是否需要将内存回收给中心缓存
-bool ThreadCache::shouldReturnToCentralCache(size_t index)
+void ThreadCache::deallocate(void* ptr)
 {
-    // 设定阈值，例如：当自由链表的大小超过一定数量时
-    // 大块阈值低，小块阈值高
-    const size_t size = (index + 1) * ALIGNMENT;
+    // 所有内存都来自 PageCache，页表里查不到说明不是本内存池分配的
+    PageCache::Span* span = PageCache::getInstance().mapObjectToSpan(ptr);
+    assert(span);
+    if (!span) return;
 
-    // 可调常量
-    const size_t kBudgetBytes = 64 * 1024; // 每个size-class在线程本地的目标预算
-    const size_t kMinBlocks   = 8;         // 最小阈值
-    const size_t kMaxBlocks   = 384;      // 最大阈值，保护极小块
+    if (span->isLarge)
+    {
+        LargeCache::getInstance().deallocate(span);
+        return;
+    }
 
-    size_t threshold = kBudgetBytes / size;
-    if (threshold < kMinBlocks) threshold = kMinBlocks;
-    if (threshold > kMaxBlocks) threshold = kMaxBlocks;
-    return freeListSize_[index] > threshold;
+    freeToLocal(span->sizeClass, ptr);
 }
 
-
-void ThreadCache::returnToCentralCache(void* start, size_t index)
+size_t ThreadCache::usableSize(const void* ptr)
 {
-    // 计算要归还内存块数量
-    size_t batchNum = freeListSize_[index];
-    // 如果只有一个块，则不归还
-    if (batchNum <= 1) return;
+    if (!ptr) return 0;
 
-    // 保留一部分在ThreadCache中（比如保留1/4）
-    size_t keepNum = std::max(batchNum / 4, size_t(1));
-    size_t returnNum = batchNum - keepNum;
+    PageCache::Span* span = PageCache::getInstance().mapObjectToSpan(ptr);
+    if (!span) return 0;
 
-    // 将内存块串成链表
-    char* current = static_cast<char*>(start);
+    // 大对象可能是按大于一页对齐返回的span中间的地址，算到span末尾
+    if (span->isLarge)
+    {
+        return static_cast<const char*>(span->pageAddr) + span->objSize - static_cast<const char*>(ptr);
+    }
+    return span->objSize;
+}
 
-    // 使用对齐后的大小计算分割点
-    char* splitNode = current;
-    for (size_t i = 0; i < keepNum - 1; ++i) 
+void ThreadCache::listTooLong(size_t index)
+{
+    FreeList& list = freeList_[index];
+    size_t batch = SizeClass::classBatch(index);
+
+    // 慢启动阶段：上限还不到一批，先放宽一块，放宽后还超出上限的部分还掉
+    if (list.maxLength < batch)
     {
-        splitNode = reinterpret_cast<char*>(*reinterpret_cast<void**>(splitNode));
-        if (splitNode == nullptr) 
+        setMaxLength(index, list.maxLength + 1);
+        if (list.length > list.maxLength)
         {
-            // 如果链表提前结束，更新实际的返回数量
-            returnNum = batchNum - (i + 1);
-            break;
+            returnToCentralCache(index, list.length - list.maxLength);
         }
+        checkBudget();
+        return;
+    }
+
+    // 还一批给中心缓存；连续超长好几次，说明上限给多了，收回一批
+    overflows_[index].fetch_add(1, std::memory_order_relaxed);
+    lastActive_.store(nowMs(), std::memory_order_relaxed);
+    returnToCentralCache(index, batch);
+    if (++list.overages > MAX_OVERAGES)
+    {
+        setMaxLength(index, std::max(list.maxLength - batch, batch));
+        list.overages = 0;
     }
+    checkBudget();
+}
+
+void ThreadCache::setMaxLength(size_t index, size_t maxLength)
+{
+    FreeList& list = freeList_[index];
+    size_t size = SizeClass::classSize(index);
+    size_t capacity = capacity_.load(std::memory_order_relaxed) - list.maxLength * size + maxLength * size;
+    capacity_.store(capacity, std::memory_order_relaxed);
+    list.maxLength = maxLength;
+}
 
-    if (splitNode != nullptr) 
+void ThreadCache::returnToCentralCache(size_t index, size_t num)
+{
+    FreeList& list = freeList_[index];
+    num = std::min(num, list.length);
+    if (num == 0) return;
+
+    // 从链表头摘 num 块：都是刚释放的，还在缓存里，走一遍很便宜
+    void* start = list.head;
+    void* end = start;
+    for (size_t i = 1; i < num; ++i)
     {
-        // 将要返回的部分和要保留的部分断开
-        void* nextNode = *reinterpret_cast<void**>(splitNode);
-        *reinterpret_cast<void**>(splitNode) = nullptr; // 断开连接
+        end = *reinterpret_cast<void**>(end);
+    }
+    list.head = *reinterpret_cast<void**>(end);
+    list.length -= num;
+    list.returned += num;
 
-        // 更新ThreadCache的空闲链表
-        freeList_[index] = start;
+    CentralCache::getInstance().returnRange(start, end, num, index);
+}
 
-        // 更新自由链表大小
-        freeListSize_[index] = keepNum;
+void ThreadCache::addClassStats(size_t index, ClassStats& stats) const
+{
+    // 本线程以外的人来读：这几个字段只有本线程写，原子读避免撕裂，几个字段之间不保证一致
+    const FreeList& list = freeList_[index];
+    size_t length   = __atomic_load_n(&list.length, __ATOMIC_RELAXED);
+    size_t frees    = __atomic_load_n(&list.frees, __ATOMIC_RELAXED);
+    size_t fetched  = __atomic_load_n(&list.fetched, __ATOMIC_RELAXED);
+    size_t returned = __atomic_load_n(&list.returned, __ATOMIC_RELAXED);
+
+    // 进出本地链的块数守恒：fetched + frees = allocs + returned + length
+    stats.allocs       += fetched + frees - returned - length;
+    stats.frees        += frees;
+    stats.cachedBlocks += length;
+}
 
-        // 将剩余部分返回给CentralCache
-        if (returnNum > 0 && nextNode != nullptr)
-        {
-            //返回给中心缓存的链表头，归还块数以及索引index
-            CentralCache::getInstance().returnRange(nextNode, returnNum, index);
-        }
+ThreadCache::ClassStats ThreadCache::classStats(size_t index)
+{
+    ClassStats stats{};
+    if (index >= FREE_LIST_SIZE) return stats;
+    stats.misses    = misses_[index].load(std::memory_order_relaxed);
+    stats.overflows = overflows_[index].load(std::memory_order_relaxed);
+
+    std::lock_guard<SpinLock> guard(registryLock);
+    stats.allocs = retiredAllocs[index];
+    stats.frees  = retiredFrees[index];
+    for (ThreadCache* c = registryHead; c; c = c->regNext_)
+    {
+        c->addClassStats(index, stats);
     }
+    return stats;
 }
 
-void ThreadCache::freeToLocal(size_t index, void* ptr) {
-    *reinterpret_cast<void**>(ptr) = freeList_[index];
-    freeList_[index] = ptr;
-    ++freeListSize_[index];
+std::array<ThreadCache::ClassStats, FREE_LIST_SIZE> ThreadCache::allClassStats()
+{
+    std::array<ClassStats, FREE_LIST_SIZE> all{};
+    for (size_t index = 0; index < FREE_LIST_SIZE; ++index)
+    {
+        all[index].misses    = misses_[index].load(std::memory_order_relaxed);
+        all[index].overflows = overflows_[index].load(std::memory_order_relaxed);
+    }
 
-    if (shouldReturnToCentralCache(index)) {
-        returnToCentralCache(freeList_[index], index); // 注意 returnRange 传“块数”
+    // 一次拿锁把所有线程的所有档都加上
+    std::lock_guard<SpinLock> guard(registryLock);
+    for (size_t index = 0; index < FREE_LIST_SIZE; ++index)
+    {
+        all[index].allocs = retiredAllocs[index];
+        all[index].frees  = retiredFrees[index];
+    }
+    for (ThreadCache* c = registryHead; c; c = c->regNext_)
+    {
+        for (size_t index = 0; index < FREE_LIST_SIZE; ++index)
+        {
+            c->addClassStats(index, all[index]);
+        }
     }
+    return all;
 }
@@ -0,0 +1,264 @@
+// libmemorypool.so：用内存池整体替换 malloc/free/new/delete
+// 用法：LD_PRELOAD=libmemorypool.so ./app，或者直接链接这个库；进程里所有的分配（包括第三方库）都走内存池
+// 内存池内部的元数据全部来自 MetaArena/mmap，不会反过来调用 malloc
+#include "MemoryPool.h"
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <new>
+
+#define MEMORYPOOL_EXPORT extern "C" __attribute__((visibility("default")))
+
+namespace
+{
+    inline bool isPowerOfTwo(size_t x)
+    {
+        return x && !(x & (x - 1));
+    }
+
+    inline void* poolMalloc(size_t size)
+    {
+        // 和 glibc 一样拒绝超过 PTRDIFF_MAX 的请求，后面按页取整也不会溢出
+        if (size > size_t(PTRDIFF_MAX))
+        {
+            errno = ENOMEM;
+            return nullptr;
+        }
+
+        void* ptr = MemoryPool::allocate(size);
+        if (!ptr) errno = ENOMEM;
+        return ptr;
+    }
+
+    inline void* poolMemalign(size_t alignment, size_t size)
+    {
+        if (size > size_t(PTRDIFF_MAX))
+        {
+            errno = ENOMEM;
+            return nullptr;
+        }
+
+        void* ptr = MemoryPool::allocateAligned(size, alignment);
+        if (!ptr) errno = ENOMEM;
+        return ptr;
+    }
+
+    // operator new：失败时调 new_handler，没有 handler 就抛 bad_alloc
+    template <typename Alloc>
+    void* newImpl(Alloc alloc)
+    {
+        while (true)
+        {
+            void* ptr = alloc();
+            if (ptr) return ptr;
+
+            std::new_handler handler = std::get_new_handler();
+            if (!handler) throw std::bad_alloc();
+            handler();
+        }
+    }
+
+    template <typename Alloc>
+    void* newNothrowImpl(Alloc alloc) noexcept
+    {
+        try
+        {
+            return newImpl(alloc);
+        }
+        catch (...)
+        {
+            return nullptr;
+        }
+    }
+}
+
+MEMORYPOOL_EXPORT void* malloc(size_t size)
+{
+    return poolMalloc(size);
+}
+
+MEMORYPOOL_EXPORT void free(void* ptr)
+{
+    MemoryPool::deallocate(ptr);
+}
+
+MEMORYPOOL_EXPORT void* calloc(size_t count, size_t size)
+{
+    size_t bytes;
+    if (__builtin_mul_overflow(count, size, &bytes))
+    {
+        errno = ENOMEM;
+        return nullptr;
+    }
+
+    void* ptr = poolMalloc(bytes);
+    if (ptr) std::memset(ptr, 0, bytes);
+    return ptr;
+}
+
+MEMORYPOOL_EXPORT void* realloc(void* ptr, size_t size)
+{
+    if (!ptr) return poolMalloc(size);
+    if (size == 0)
+    {
+        MemoryPool::deallocate(ptr);
+        return nullptr;
+    }
+
+    if (size > size_t(PTRDIFF_MAX))
+    {
+        errno = ENOMEM;
+        return nullptr;
+    }
+
+    void* fresh = MemoryPool::reallocate(ptr, size);
+    if (!fresh) errno = ENOMEM;
+    return fresh;
+}
+
+MEMORYPOOL_EXPORT int posix_memalign(void** out, size_t alignment, size_t size)
+{
+    if (!isPowerOfTwo(alignment) || alignment % sizeof(void*) != 0) return EINVAL;
+
+    void* ptr = poolMemalign(alignment, size);
+    if (!ptr) return ENOMEM;
+    *out = ptr;
+    return 0;
+}
+
+MEMORYPOOL_EXPORT void* aligned_alloc(size_t alignment, size_t size)
+{
+    if (!isPowerOfTwo(alignment))
+    {
+        errno = EINVAL;
+        return nullptr;
+    }
+    return poolMemalign(alignment, size);
+}
+
+MEMORYPOOL_EXPORT void* memalign(size_t alignment, size_t size)
+{
+    if (!isPowerOfTwo(alignment))
+    {
+        errno = EINVAL;
+        return nullptr;
+    }
+    return poolMemalign(alignment, size);
+}
+
+MEMORYPOOL_EXPORT void* valloc(size_t size)
+{
+    return poolMemalign(PAGE_SIZE, size);
+}
+
+MEMORYPOOL_EXPORT void* pvalloc(size_t size)
+{
+    return poolMemalign(PAGE_SIZE, (size + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE);
+}
+
+MEMORYPOOL_EXPORT size_t malloc_usable_size(void* ptr)
+{
+    return MemoryPool::usableSize(ptr);
+}
+
+// operator new/delete：带大小的 delete 直接按大小找 size-class，省掉一次页表查询
+
+void* operator new(size_t size)
+{
+    return newImpl([size] { return MemoryPool::allocate(size); });
+}
+
+void* operator new[](size_t size)
+{
+    return newImpl([size] { return MemoryPool::allocate(size); });
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return newNothrowImpl([size] { return MemoryPool::allocate(size); });
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return newNothrowImpl([size] { return MemoryPool::allocate(size); });
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    return newImpl([=] { return poolMemalign(static_cast<size_t>(alignment), size); });
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    return newImpl([=] { return poolMemalign(static_cast<size_t>(alignment), size); });
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return newNothrowImpl([=] { return poolMemalign(static_cast<size_t>(alignment), size); });
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return newNothrowImpl([=] { return poolMemalign(static_cast<size_t>(alignment), size); });
+}
+
+void operator delete(void* ptr) noexcept
+{
+    MemoryPool::deallocate(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    MemoryPool::deallocate(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+    MemoryPool::deallocate(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+    MemoryPool::deallocate(ptr);
+}
+
+void operator delete(void* ptr, size_t size) noexcept
+{
+    if (ptr) MemoryPool::deallocate(ptr, size);
+}
+
+void operator delete[](void* ptr, size_t size) noexcept
+{
+    if (ptr) MemoryPool::deallocate(ptr, size);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept
+{
+    MemoryPool::deallocate(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept
+{
+    MemoryPool::deallocate(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    MemoryPool::deallocate(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    MemoryPool::deallocate(ptr);
+}
+
+void operator delete(void* ptr, size_t size, std::align_val_t alignment) noexcept
+{
+    MemoryPool::deallocateAligned(ptr, size, static_cast<size_t>(alignment));
+}
+
+void operator delete[](void* ptr, size_t size, std::align_val_t alignment) noexcept
+{
+    MemoryPool::deallocateAligned(ptr, size, static_cast<size_t>(alignment));
+}
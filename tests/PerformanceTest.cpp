@@ -5,8 +5,16 @@
 #include <random>
 #include <iomanip>
 #include <thread>
+#include <fstream>
+#include <cstring>
+#include <unistd.h>
+#include <sys/wait.h>
 #include "PageCache.h"
 #include "mymemory.h"
+#include "PoolAllocator.h"
+#include "ObjectPool.h"
+#include <map>
+#include <unordered_map>
 
 using namespace std::chrono;
 #define nomy 0
@@ -25,6 +33,32 @@ public:
     }
 };
 
+// 当前进程常驻内存（MB）
+static double residentMB()
+{
+    std::ifstream statm("/proc/self/statm");
+    size_t size = 0, resident = 0;
+    statm >> size >> resident;
+    return resident * static_cast<double>(sysconf(_SC_PAGESIZE)) / (1024.0 * 1024.0);
+}
+
+// 当前进程实际由透明大页承载的内存（MB）
+static double anonHugePagesMB()
+{
+    std::ifstream smaps("/proc/self/smaps_rollup");
+    std::string key;
+    size_t kb = 0;
+    while (smaps >> key) 
+    {
+        if (key == "AnonHugePages:") 
+        {
+            smaps >> kb;
+            break;
+        }
+    }
+    return kb / 1024.0;
+}
+
 // 性能测试类
 class PerformanceTest 
 {
@@ -72,6 +106,55 @@ public:
         std::cout << "Warmup complete.\n\n";
     }
 
+    // 1.5 大页模式对比：随机访问大量小对象，dTLB 压力大；每种模式在单独的子进程里从干净状态跑
+    static void testHugePages() 
+    {
+        constexpr size_t OBJ_SIZE = 1024;
+        constexpr size_t NUM_OBJS = 128 * 1024;       // 128MB
+        constexpr size_t NUM_ACCESSES = 20 * 1000 * 1000;
+
+        std::cout << "Testing random access over " << NUM_OBJS * OBJ_SIZE / (1024 * 1024) 
+                  << " MB of " << OBJ_SIZE << "-byte objects (" << NUM_ACCESSES << " accesses):" << std::endl;
+
+        for (bool huge : {false, true}) 
+        {
+            std::cout.flush();
+            pid_t pid = fork();
+            if (pid != 0) 
+            {
+                waitpid(pid, nullptr, 0);
+                continue;
+            }
+
+            MemoryPool::setHugePageMode(huge);
+            std::vector<char*> objs(NUM_OBJS);
+            for (size_t i = 0; i < NUM_OBJS; ++i) 
+            {
+                objs[i] = static_cast<char*>(MemoryPool::allocate(OBJ_SIZE));
+                std::memset(objs[i], static_cast<int>(i), OBJ_SIZE);
+            }
+
+            std::mt19937_64 gen(42);
+            size_t sum = 0;
+            Timer t;
+            for (size_t i = 0; i < NUM_ACCESSES; ++i) 
+            {
+                size_t r = gen();
+                sum += static_cast<unsigned char>(objs[r % NUM_OBJS][(r >> 32) % OBJ_SIZE]);
+            }
+            double ms = t.elapsed();
+
+            PageCache::HugePageStats stats = MemoryPool::hugePageStats();
+            std::cout << (huge ? "Huge pages on:  " : "Huge pages off: ") << std::fixed << std::setprecision(3)
+                      << ms << " ms (huge pages full " << stats.full << ", partial " << stats.partial 
+                      << ", broken " << stats.broken << ", THP-backed " << std::setprecision(1) 
+                      << anonHugePagesMB() << " MB, checksum " << sum % 1000 << ")" << std::endl;
+            std::cout.flush();
+            _exit(0);
+        }
+        std::cout << std::endl;
+    }
+
     // 2. 小对象分配测试
     static void testSmallAllocation() 
     {
@@ -257,7 +340,424 @@ public:
         }
     }
     
-    // 4. 混合大小测试
+    // 4. 线程创建到第一次分配完成的延迟（包含 ThreadCache 的创建成本）
+    static void testThreadStartup()
+    {
+        constexpr size_t NUM_THREADS = 200;
+        constexpr size_t FIRST_SIZE = 64;
+
+        std::cout << "\nTesting thread-creation-to-first-allocation latency (" << NUM_THREADS
+                  << " threads, " << FIRST_SIZE << " bytes):" << std::endl;
+
+        auto measure = [](bool useMemPool) 
+        {
+            double total = 0.0;
+            for (size_t i = 0; i < NUM_THREADS; ++i) 
+            {
+                high_resolution_clock::time_point firstAlloc;
+                auto created = high_resolution_clock::now();
+                std::thread th([&firstAlloc, useMemPool]() 
+                {
+                    if (useMemPool) 
+                    {
+#if nomy
+                        void* p = MemoryPool::allocate(FIRST_SIZE);
+#else
+                        void* p = CMemory::GetInstance()->AllocMemory(FIRST_SIZE, false);
+#endif
+                        firstAlloc = high_resolution_clock::now();
+#if nomy
+                        MemoryPool::deallocate(p, FIRST_SIZE);
+#else
+                        CMemory::GetInstance()->FreeMemory(p);
+#endif
+                    } 
+                    else 
+                    {
+                        char* p = new char[FIRST_SIZE];
+                        firstAlloc = high_resolution_clock::now();
+                        delete[] p;
+                    }
+                });
+                th.join();
+                total += duration_cast<nanoseconds>(firstAlloc - created).count() / 1000.0;
+            }
+            return total / NUM_THREADS; // 平均微秒
+        };
+
+        std::cout << "Memory Pool: " << std::fixed << std::setprecision(3) 
+                  << measure(true) << " us/thread" << std::endl;
+        std::cout << "New/Delete: " << std::fixed << std::setprecision(3) 
+                  << measure(false) << " us/thread" << std::endl;
+    }
+
+    // 5. 峰值后空闲：释放后 RSS 能否降下来
+    static void testPeakThenTrim()
+    {
+        constexpr size_t PEAK_BYTES = 256 * 1024 * 1024;
+        const size_t SIZES[] = {64, 256, 1024, 4096, 16384, 65536};
+
+        std::cout << "\nTesting peak-then-idle RSS (" << PEAK_BYTES / (1024 * 1024) 
+                  << " MB peak):" << std::endl;
+
+        std::vector<void*> ptrs;
+        size_t total = 0;
+        for (size_t i = 0; total < PEAK_BYTES; ++i) 
+        {
+            size_t size = SIZES[i % 6];
+            void* p = MemoryPool::allocate(size);
+            std::memset(p, 1, size);   // 真正写进去，让页常驻
+            ptrs.push_back(p);
+            total += size;
+        }
+        double peak = residentMB();
+
+        for (void* p : ptrs) 
+        {
+            MemoryPool::deallocate(p);
+        }
+        double afterFree = residentMB();
+
+        Timer t;
+        size_t released = MemoryPool::trim();
+        double trimMs = t.elapsed();
+
+        std::cout << "RSS at peak: " << std::fixed << std::setprecision(1) << peak << " MB" << std::endl;
+        std::cout << "RSS after free: " << afterFree << " MB" << std::endl;
+        std::cout << "RSS after trim: " << residentMB() << " MB (released " 
+                  << released / (1024 * 1024) << " MB in " << std::setprecision(3) << trimMs << " ms)" << std::endl;
+    }
+
+    // 大对象反复申请释放：每次都写满，缺页代价计入
+    static void testLargeChurn()
+    {
+        constexpr size_t NUM_ROUNDS = 2000;
+        const size_t SIZES[] = {300 * 1024, 512 * 1024, 1024 * 1024, 4 * 1024 * 1024};
+
+        std::cout << "\nTesting large buffer churn (" << NUM_ROUNDS 
+                  << " rounds of 300KB-4MB):" << std::endl;
+
+        {
+            Timer t;
+            for (size_t i = 0; i < NUM_ROUNDS; ++i) 
+            {
+                size_t size = SIZES[i % 4];
+                void* p = MemoryPool::allocate(size);
+                std::memset(p, 1, size);
+                MemoryPool::deallocate(p, size);
+            }
+            std::cout << "Memory Pool: " << std::fixed << std::setprecision(3) 
+                      << t.elapsed() << " ms" << std::endl;
+        }
+
+        {
+            Timer t;
+            for (size_t i = 0; i < NUM_ROUNDS; ++i) 
+            {
+                size_t size = SIZES[i % 4];
+                char* p = new char[size];
+                std::memset(p, 1, size);
+                delete[] p;
+            }
+            std::cout << "New/Delete: " << std::fixed << std::setprecision(3) 
+                      << t.elapsed() << " ms" << std::endl;
+        }
+    }
+
+    // 定长对象：运行时算 size-class 的 allocate(size)、编译期算好的 ObjectPool 和 new/delete 对比
+    static void testObjectPool()
+    {
+        constexpr size_t NUM_OPS = 2000000;
+        constexpr size_t BATCH   = 64;
+
+        struct Message
+        {
+            explicit Message(uint64_t id) : id(id), type(1), length(0) {}
+
+            uint64_t id;
+            uint32_t type;
+            uint32_t length;
+            char     payload[48];
+        };
+
+        std::cout << "\nTesting fixed-size objects (" << NUM_OPS << " create/destroy, "
+                  << sizeof(Message) << "B, batches of " << BATCH << "):" << std::endl;
+
+        // 每轮申请一批再倒序释放，链表头来回摆动
+        auto run = [](auto create, auto destroy)
+        {
+            Message* batch[BATCH];
+            Timer t;
+            for (size_t i = 0; i < NUM_OPS / BATCH; ++i)
+            {
+                for (size_t j = 0; j < BATCH; ++j) batch[j] = create(j);
+                for (size_t j = BATCH; j-- > 0; ) destroy(batch[j]);
+            }
+            return t.elapsed() * 1e6 / NUM_OPS;
+        };
+
+        double pool = run(
+            [](size_t j) { return new (MemoryPool::allocate(sizeof(Message))) Message(j); },
+            [](Message* m) { m->~Message(); MemoryPool::deallocate(m, sizeof(Message)); });
+        double objectPool = run(
+            [](size_t j) { return ObjectPool<Message>::create(j); },
+            [](Message* m) { ObjectPool<Message>::destroy(m); });
+        double system = run(
+            [](size_t j) { return new Message(j); },
+            [](Message* m) { delete m; });
+
+        std::cout << "MemoryPool::allocate(size): " << std::fixed << std::setprecision(2) << pool << " ns/op" << std::endl;
+        std::cout << "ObjectPool<T>:              " << objectPool << " ns/op" << std::endl;
+        std::cout << "New/Delete:                 " << system << " ns/op" << std::endl;
+    }
+
+    // 一次几十个同样大小的结点：逐块申请/释放和批量接口对比
+    static void testBatchAllocation()
+    {
+        constexpr size_t NUM_ROUNDS = 100000;
+        constexpr size_t BATCH      = 48;
+        constexpr size_t SIZE       = 48;
+
+        std::cout << "\nTesting batch allocation (" << NUM_ROUNDS << " rounds x " << BATCH
+                  << " blocks of " << SIZE << "B):" << std::endl;
+
+        void* ptrs[BATCH];
+        {
+            Timer t;
+            for (size_t i = 0; i < NUM_ROUNDS; ++i)
+            {
+                for (size_t j = 0; j < BATCH; ++j) ptrs[j] = MemoryPool::allocate(SIZE);
+                for (size_t j = 0; j < BATCH; ++j) MemoryPool::deallocate(ptrs[j], SIZE);
+            }
+            std::cout << "One by one: " << std::fixed << std::setprecision(2)
+                      << t.elapsed() * 1e6 / (NUM_ROUNDS * BATCH) << " ns/block" << std::endl;
+        }
+        {
+            Timer t;
+            for (size_t i = 0; i < NUM_ROUNDS; ++i)
+            {
+                MemoryPool::allocateBatch(SIZE, BATCH, ptrs);
+                MemoryPool::deallocateBatch(ptrs, BATCH, SIZE);
+            }
+            std::cout << "Batch:      " << std::fixed << std::setprecision(2)
+                      << t.elapsed() * 1e6 / (NUM_ROUNDS * BATCH) << " ns/block" << std::endl;
+        }
+    }
+
+    // 堆分析器：关着和按默认采样率打开时，混合大小的随机申请/释放各跑一遍
+    static double profiledChurn()
+    {
+        constexpr size_t NUM_OPS   = 2000000;
+        constexpr size_t NUM_SLOTS = 4096;
+
+        std::mt19937 rng(7);
+        std::vector<void*> slots(NUM_SLOTS, nullptr);
+        std::vector<size_t> sizes(NUM_SLOTS, 0);
+        Timer t;
+        for (size_t i = 0; i < NUM_OPS; ++i)
+        {
+            size_t slot = rng() % NUM_SLOTS;
+            if (slots[slot]) MemoryPool::deallocate(slots[slot], sizes[slot]);
+            sizes[slot] = 16 + rng() % 2048;
+            slots[slot] = MemoryPool::allocate(sizes[slot]);
+        }
+        double ms = t.elapsed();
+        for (size_t i = 0; i < NUM_SLOTS; ++i)
+        {
+            if (slots[i]) MemoryPool::deallocate(slots[i], sizes[i]);
+        }
+        return ms;
+    }
+
+    static void testHeapProfiler()
+    {
+        std::cout << "\nTesting heap profiler overhead (2M random 16B-2KB alloc/free, default 2MB sampling):"
+                  << std::endl;
+
+        double off = profiledChurn();
+        MemoryPool::startHeapProfiler();
+        double on = profiledChurn();
+        MemoryPool::stopHeapProfiler();
+
+        HeapProfiler::Stats stats = HeapProfiler::stats();
+        std::cout << "Profiler off: " << std::fixed << std::setprecision(3) << off << " ms" << std::endl;
+        std::cout << "Profiler on:  " << std::fixed << std::setprecision(3) << on << " ms ("
+                  << std::setprecision(1) << (on / off - 1) * 100 << "% overhead, "
+                  << stats.totalSamples << " samples)" << std::endl;
+    }
+
+    // 结点型容器的增删：std::allocator（全局 new）和 PoolAllocator 对比
+    template <template <typename> class Alloc>
+    static double containerChurn(bool hashed)
+    {
+        constexpr int NUM_KEYS = 100000;
+        constexpr int NUM_ROUNDS = 5;
+
+        using Value = std::pair<const int, int>;
+        using Map = std::map<int, int, std::less<int>, Alloc<Value>>;
+        using HashMap = std::unordered_map<int, int, std::hash<int>, std::equal_to<int>, Alloc<Value>>;
+
+        std::mt19937 rng(42);
+        Timer t;
+        for (int round = 0; round < NUM_ROUNDS; ++round)
+        {
+            Map map;
+            HashMap hashMap;
+            for (int i = 0; i < NUM_KEYS; ++i)
+            {
+                int key = static_cast<int>(rng() % (NUM_KEYS * 4));
+                if (hashed) hashMap[key] = i;
+                else map[key] = i;
+
+                // 边插边删，结点在容器之间不停周转
+                if (i % 3 == 0)
+                {
+                    int victim = static_cast<int>(rng() % (NUM_KEYS * 4));
+                    if (hashed) hashMap.erase(victim);
+                    else map.erase(victim);
+                }
+            }
+        }
+        return t.elapsed();
+    }
+
+    static void testContainerChurn()
+    {
+        std::cout << "\nTesting node container churn (5 rounds x 100000 inserts, 1/3 erases):" << std::endl;
+
+        for (bool hashed : {false, true})
+        {
+            const char* name = hashed ? "unordered_map" : "map";
+            double system = containerChurn<std::allocator>(hashed);
+            double pool = containerChurn<PoolAllocator>(hashed);
+            std::cout << std::left << std::setw(14) << name << std::right
+                      << "std::allocator " << std::fixed << std::setprecision(3) << system << " ms, "
+                      << "PoolAllocator " << pool << " ms" << std::endl;
+        }
+    }
+
+    // 线程数扩展性：每个线程反复整批申请、整批释放，让块在 ThreadCache 和中心缓存之间来回搬
+    static void testThreadScaling()
+    {
+        constexpr size_t ROUNDS = 200;
+        constexpr size_t BATCH  = 1024;   // 超过 ThreadCache 的本地上限，每轮都会还一部分给中心缓存
+        const size_t SIZES[] = {32, 64, 256};
+        const size_t THREAD_COUNTS[] = {1, 2, 4, 8, 16, 32};
+
+        std::cout << "\nTesting thread scaling (" << ROUNDS << " rounds x " << BATCH 
+                  << " blocks per thread, Mops/s):" << std::endl;
+
+        auto run = [&](size_t numThreads, bool useMemPool) 
+        {
+            Timer t;
+            std::vector<std::thread> threads;
+            for (size_t i = 0; i < numThreads; ++i) 
+            {
+                threads.emplace_back([&, i]() 
+                {
+                    std::vector<void*> ptrs(BATCH);
+                    const size_t size = SIZES[i % 3];
+                    for (size_t r = 0; r < ROUNDS; ++r) 
+                    {
+                        for (size_t j = 0; j < BATCH; ++j) 
+                        {
+                            ptrs[j] = useMemPool ? MemoryPool::allocate(size) : new char[size];
+                        }
+                        for (size_t j = 0; j < BATCH; ++j) 
+                        {
+                            if (useMemPool) MemoryPool::deallocate(ptrs[j], size);
+                            else delete[] static_cast<char*>(ptrs[j]);
+                        }
+                    }
+                });
+            }
+            for (auto& thread : threads) 
+            {
+                thread.join();
+            }
+            // 一次申请加一次释放算一次操作
+            return numThreads * ROUNDS * BATCH / (t.elapsed() * 1000.0);
+        };
+
+        for (size_t numThreads : THREAD_COUNTS) 
+        {
+            double pool = run(numThreads, true);
+            double sys  = run(numThreads, false);
+            std::cout << std::setw(3) << numThreads << " threads: Memory Pool " << std::fixed 
+                      << std::setprecision(2) << pool << ", New/Delete " << sys << std::endl;
+        }
+    }
+
+    // 线程缓存 vs 每 CPU 缓存：单线程热路径，以及远多于核数的线程各自用过一圈后前端缓存了多少
+    static void testPerCpuCache()
+    {
+        constexpr size_t NUM_OPS     = 2000000;
+        constexpr size_t NUM_THREADS = 64;
+
+        std::cout << "\nTesting thread cache vs per-CPU cache:" << std::endl;
+        if (!MemoryPool::setPerCpuCache(true))
+        {
+            std::cout << "rseq unavailable, skipped" << std::endl;
+            return;
+        }
+
+        auto hotLoop = []() 
+        {
+            Timer t;
+            for (size_t i = 0; i < NUM_OPS; ++i) 
+            {
+                void* p = MemoryPool::allocate(32);
+                MemoryPool::deallocate(p, 32);
+            }
+            return t.elapsed() * 1e6 / NUM_OPS;
+        };
+
+        // 每个线程用一圈各种大小后停住，统计此刻前端缓存住的字节数
+        auto idleThreads = []() 
+        {
+            std::atomic<size_t> ready{0};
+            std::atomic<bool> done{false};
+            std::vector<std::thread> threads;
+            for (size_t i = 0; i < NUM_THREADS; ++i) 
+            {
+                threads.emplace_back([&]() 
+                {
+                    std::vector<std::pair<void*, size_t>> ptrs;
+                    for (size_t j = 0; j < 2000; ++j) 
+                    {
+                        size_t size = 16 << (j % 9);
+                        ptrs.emplace_back(MemoryPool::allocate(size), size);
+                    }
+                    for (auto& [p, size] : ptrs) 
+                    {
+                        MemoryPool::deallocate(p, size);
+                    }
+                    ++ready;
+                    while (!done) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                });
+            }
+            while (ready < NUM_THREADS) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            double mb = CpuCache::cachedBytes() / (1024.0 * 1024.0);
+            done = true;
+            for (auto& thread : threads) 
+            {
+                thread.join();
+            }
+            return mb;
+        };
+
+        double cpuNs = hotLoop();
+        double cpuCached = idleThreads();
+        MemoryPool::setPerCpuCache(false);
+        double tlsNs = hotLoop();
+
+        std::cout << "Hot path (32B alloc+free): thread cache " << std::fixed << std::setprecision(2) 
+                  << tlsNs << " ns, per-CPU " << cpuNs << " ns" << std::endl;
+        std::cout << NUM_THREADS << " idle threads: per-CPU front end caches " 
+                  << cpuCached << " MB (bounded by " << std::thread::hardware_concurrency() << " CPUs)" << std::endl;
+    }
+
+    // 6. 混合大小测试
     static void testMixedSizes() 
     {
         //constexpr size_t NUM_ALLOCS = 50000;
@@ -354,13 +854,25 @@ int main()
     std::cout << "Starting performance tests..." << std::endl;
     std::cout << std::endl;
     
+    // 大页对比要在干净的进程状态下 fork，放在最前面
+    PerformanceTest::testHugePages();
+
     // 预热系统
     PerformanceTest::warmup();
     
     // 运行测试
     PerformanceTest::testSmallAllocation();
     PerformanceTest::testMultiThreaded();
+    PerformanceTest::testThreadScaling();
+    PerformanceTest::testPerCpuCache();
+    PerformanceTest::testObjectPool();
+    PerformanceTest::testBatchAllocation();
+    PerformanceTest::testHeapProfiler();
+    PerformanceTest::testThreadStartup();
     PerformanceTest::testMixedSizes();
+    PerformanceTest::testLargeChurn();
+    PerformanceTest::testContainerChurn();
+    PerformanceTest::testPeakThenTrim();
 
     PageCache::getInstance().shutdown();  // 显式清理
 
@@ -7,8 +7,15 @@
 #include <random>
 #include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <PageCache.h>
 #include "mymemory.h"
+#include "PoolAllocator.h"
+#include "ObjectPool.h"
+#include <stdexcept>
+#include <list>
+#include <map>
+#include <unordered_map>
 
 #define nomy 0
 
@@ -264,6 +271,1120 @@ void testEdgeCases()
     std::cout<<std::endl;
 }
 
+// size-class 表测试
+void testSizeClasses()
+{
+    std::cout << "Running size class test..." << std::endl;
+    std::cout<<std::endl;
+
+    assert(FREE_LIST_SIZE >= 60 && FREE_LIST_SIZE <= 100);
+
+    for (size_t i = 1; i < FREE_LIST_SIZE; ++i)
+    {
+        // 档位严格递增，且都满足对齐
+        assert(SizeClass::classSize(i) > SizeClass::classSize(i - 1));
+        assert(SizeClass::classSize(i) % ALIGNMENT == 0);
+    }
+
+    for (size_t size = 1; size <= MAX_BYTES; ++size)
+    {
+        [[maybe_unused]] size_t index = SizeClass::getIndex(size);
+        assert(index < FREE_LIST_SIZE);
+        // 落在第一个能装下它的档位
+        assert(SizeClass::classSize(index) >= size);
+        assert(index == 0 || SizeClass::classSize(index - 1) < size);
+        // 128B 以上内部浪费不超过 1/8
+        if (size > SMALL_CLASS_MAX)
+        {
+            assert((SizeClass::classSize(index) - size) * 8 <= SizeClass::classSize(index));
+        }
+    }
+
+    std::cout << "Size class test passed!" << std::endl;
+    std::cout<<std::endl;
+}
+
+// 线程退出回收测试：退出线程缓存的内存块要能被后来的线程用上
+void testThreadExitRecycle()
+{
+    std::cout << "Running thread exit recycle test..." << std::endl;
+    std::cout<<std::endl;
+
+    // 选一个其他测试用不到的 size-class，避免别的线程干扰
+    const size_t size = 100000;
+
+    auto runOnce = [size]() 
+    {
+        void* freed = nullptr;
+        std::thread([&freed, size]() 
+        {
+            freed = MemoryPool::allocate(size);
+            MemoryPool::deallocate(freed, size); // 留在本线程的 ThreadCache 里
+        }).join();
+
+        void* reused = nullptr;
+        std::thread([&reused, size]() 
+        {
+            reused = MemoryPool::allocate(size);
+            MemoryPool::deallocate(reused, size);
+        }).join();
+
+        assert(freed != nullptr && reused == freed);
+    };
+
+    // 默认：线程退出时整条归还中心缓存
+    runOnce();
+
+    // 打开暂存：新线程直接接手退出线程的缓存
+    ThreadCache::setMaxParkedCaches(1);
+    runOnce();
+    ThreadCache::setMaxParkedCaches(0);
+
+    std::cout << "Thread exit recycle test passed!" << std::endl;
+    std::cout<<std::endl;
+}
+
+// span回收测试：span里的块全部释放后，整个span要还给 PageCache
+void testSpanRelease()
+{
+    std::cout << "Running span release test..." << std::endl;
+    std::cout<<std::endl;
+
+    const size_t size = 4608;   // 单独用一个 size-class
+    const size_t index = SizeClass::getIndex(size);
+    const size_t blocksPerSpan = SizeClass::classPages(index) * PAGE_SIZE / SizeClass::classSize(index);
+
+    std::vector<void*> blocks;
+    CentralCache::getInstance().flushTransferCaches();
+    [[maybe_unused]] const size_t pagesBefore = PageCache::getInstance().pagesInUse();
+    std::thread([&]() 
+    {
+        // 申请好几个span的量再全部释放，线程退出时整批还给中心缓存
+        for (size_t i = 0; i < blocksPerSpan * 4; ++i)
+        {
+            blocks.push_back(MemoryPool::allocate(size));
+        }
+        for (void* p : blocks)
+        {
+            PageCache::Span* span = PageCache::getInstance().mapObjectToSpan(p);
+            assert(span && span->objSize == SizeClass::classSize(index) && span->useCount > 0);
+            (void)span;
+        }
+        assert(PageCache::getInstance().pagesInUse() >= pagesBefore + 4 * SizeClass::classPages(index));
+        for (void* p : blocks)
+        {
+            MemoryPool::deallocate(p, size);
+        }
+    }).join();
+
+    // 线程退出时还回来的批次先停在 transfer cache，拆回span后所有span都回到 PageCache
+    CentralCache::getInstance().flushTransferCaches();
+    assert(PageCache::getInstance().pagesInUse() == pagesBefore);
+
+    std::cout << "Span release test passed!" << std::endl;
+    std::cout<<std::endl;
+}
+
+// 不带大小的释放测试
+void testSizelessFree()
+{
+    std::cout << "Running sizeless free test..." << std::endl;
+    std::cout<<std::endl;
+
+    for (size_t size : {size_t(1), size_t(16), size_t(17), size_t(100), size_t(1000), size_t(4097), size_t(70000), MAX_BYTES})
+    {
+        void* ptr = MemoryPool::allocate(size);
+        assert(ptr != nullptr);
+        // 能查到所在块的真实大小，就是 size-class 的块大小
+        assert(MemoryPool::usableSize(ptr) == SizeClass::roundUp(size));
+        MemoryPool::deallocate(ptr);
+    }
+
+    // 超过 MAX_BYTES 的也能不带大小释放
+    void* big = MemoryPool::allocate(MAX_BYTES * 2);
+    assert(MemoryPool::usableSize(big) >= MAX_BYTES * 2);
+    MemoryPool::deallocate(big);
+
+    // CMemory 不再带头部：16B 的请求只占 16B 的块
+    void* small = CMemory::GetInstance()->AllocMemory(16, true);
+    assert(MemoryPool::usableSize(small) == 16);
+    CMemory::GetInstance()->FreeMemory(small);
+
+    std::cout << "Sizeless free test passed!" << std::endl;
+    std::cout<<std::endl;
+}
+
+// PageCache 空闲span索引测试：随机切分/合并后，分出去的span互不重叠，页数能全部收回
+void testPageCacheChurn()
+{
+    std::cout << "Running page cache churn test..." << std::endl;
+    std::cout<<std::endl;
+
+    PageCache& pc = PageCache::getInstance();
+    const size_t pagesBefore = pc.pagesInUse();
+    std::mt19937 gen(12345);
+    std::vector<PageCache::Span*> spans;
+
+    for (int round = 0; round < 2000; ++round)
+    {
+        // 桶里的小span和集合里的大span都覆盖到
+        size_t pages = (gen() % 4 == 0) ? 128 + gen() % 300 : 1 + gen() % 127;
+        PageCache::Span* span = pc.allocateSpan(pages);
+        assert(span && span->numPages == pages && !span->isFree);
+        assert(pc.mapObjectToSpan(static_cast<char*>(span->pageAddr) + pages * PAGE_SIZE - 1) == span);
+        spans.push_back(span);
+
+        if (gen() % 2 && !spans.empty())
+        {
+            size_t i = gen() % spans.size();
+            pc.deallocateSpan(spans[i]);
+            spans[i] = spans.back();
+            spans.pop_back();
+        }
+    }
+
+    // 分出去的span互不重叠
+    std::sort(spans.begin(), spans.end(), [](PageCache::Span* a, PageCache::Span* b) {
+        return a->pageAddr < b->pageAddr;
+    });
+    for (size_t i = 1; i < spans.size(); ++i)
+    {
+        assert(static_cast<char*>(spans[i - 1]->pageAddr) + spans[i - 1]->numPages * PAGE_SIZE
+               <= spans[i]->pageAddr);
+    }
+
+    for (PageCache::Span* span : spans)
+    {
+        pc.deallocateSpan(span);
+    }
+    assert(pc.pagesInUse() == pagesBefore);
+    (void)pagesBefore;
+
+    std::cout << "Page cache churn test passed!" << std::endl;
+    std::cout<<std::endl;
+}
+
+// PageCache 分 arena 测试：多个线程同时申请/释放span，分出去的span互不重叠，用到了不止一个 arena，页数能全部收回
+void testPageCacheArenas()
+{
+    std::cout << "Running page cache arena test..." << std::endl;
+    std::cout<<std::endl;
+
+    PageCache& pc = PageCache::getInstance();
+    [[maybe_unused]] const size_t pagesBefore = pc.pagesInUse();
+
+    const size_t numThreads = PageCache::NUM_ARENAS;
+    std::vector<uint8_t> arenaOfThread(numThreads, 0);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < numThreads; ++t)
+    {
+        threads.emplace_back([&, t]()
+        {
+            std::mt19937 rng(static_cast<unsigned>(t));
+            std::vector<PageCache::Span*> spans;
+            for (int round = 0; round < 2000; ++round)
+            {
+                if (spans.empty() || rng() % 3 != 0)
+                {
+                    PageCache::Span* span = pc.allocateSpan(1 + rng() % 40);
+                    assert(span && span->arena.load() != 0);
+                    // 首尾写上自己的编号，别的线程拿到重叠的页就会被发现
+                    static_cast<unsigned char*>(span->pageAddr)[0] = static_cast<unsigned char>(t);
+                    static_cast<unsigned char*>(span->pageAddr)[span->numPages * PAGE_SIZE - 1] = static_cast<unsigned char>(t);
+                    spans.push_back(span);
+                    if (!arenaOfThread[t]) arenaOfThread[t] = span->arena.load();
+                }
+                else
+                {
+                    size_t pick = rng() % spans.size();
+                    PageCache::Span* span = spans[pick];
+                    assert(static_cast<unsigned char*>(span->pageAddr)[0] == t);
+                    assert(static_cast<unsigned char*>(span->pageAddr)[span->numPages * PAGE_SIZE - 1] == t);
+                    assert(pc.mapObjectToSpan(span->pageAddr) == span);
+                    spans[pick] = spans.back();
+                    spans.pop_back();
+                    pc.deallocateSpan(span);
+                }
+            }
+            for (PageCache::Span* span : spans)
+            {
+                pc.deallocateSpan(span);
+            }
+        });
+    }
+    for (auto& th : threads)
+    {
+        th.join();
+    }
+
+    // 新线程按轮转分 arena，一起起来的这几个线程不会都落在同一个 arena 上
+    std::sort(arenaOfThread.begin(), arenaOfThread.end());
+    assert(std::unique(arenaOfThread.begin(), arenaOfThread.end()) - arenaOfThread.begin() > 1);
+    assert(pc.pagesInUse() == pagesBefore);
+
+    std::cout << "Page cache arena test passed!" << std::endl;
+    std::cout<<std::endl;
+}
+
+// 归还系统测试：trim 和后台回收都能把空闲页 madvise 掉，还回来的页还能正常再用
+void testTrimAndScavenger()
+{
+    std::cout << "Running trim and scavenger test..." << std::endl;
+    std::cout<<std::endl;
+
+    PageCache& pc = PageCache::getInstance();
+    const size_t pages = 300;
+
+    // trim：写满一个span再释放，然后全部还给系统
+    PageCache::Span* span = pc.allocateSpan(pages);
+    std::memset(span->pageAddr, 0xAB, pages * PAGE_SIZE);
+    pc.deallocateSpan(span);
+
+    [[maybe_unused]] size_t totalBefore = pc.releaseStats().totalReleasedBytes;
+    size_t released = MemoryPool::trim();
+    PageCache::ReleaseStats stats = MemoryPool::releaseStats();
+    assert(released >= pages * PAGE_SIZE);
+    assert(stats.totalReleasedBytes - totalBefore == released);
+    assert(stats.releasedBytes == stats.freeBytes);  // 常驻的空闲页一页不剩
+
+    // 还给系统的页再分配出来，照样能读写
+    span = pc.allocateSpan(pages);
+    char* mem = static_cast<char*>(span->pageAddr);
+    mem[0] = 1;
+    mem[pages * PAGE_SIZE - 1] = 2;
+    assert(mem[0] == 1 && mem[pages * PAGE_SIZE - 1] == 2);
+    pc.deallocateSpan(span);
+
+    // 后台回收：不留余量，闲置即回收
+    PageCache::ScavengerOptions options;
+    options.intervalMs = 10;
+    options.idleMs = 0;
+    options.headroomBytes = 0;
+    MemoryPool::startScavenger(options);
+    for (int i = 0; i < 100 && MemoryPool::releaseStats().releasedBytes != MemoryPool::releaseStats().freeBytes; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    MemoryPool::stopScavenger();
+    stats = MemoryPool::releaseStats();
+    assert(stats.releasedBytes == stats.freeBytes);
+    (void)released;
+
+    std::cout << "Trim and scavenger test passed!" << std::endl;
+    std::cout<<std::endl;
+}
+
+// 大页模式测试：新申请的区域 2MB 对齐，统计能区分用满/部分使用/整块还给系统
+void testHugePageMode()
+{
+    std::cout << "Running huge page mode test..." << std::endl;
+    std::cout<<std::endl;
+
+    PageCache& pc = PageCache::getInstance();
+    MemoryPool::setHugePageMode(true);
+
+    // 比 PageCache 里所有空闲页加起来还大，保证是新申请的区域：若干整大页 + 半个大页
+    const size_t hugePages = pc.releaseStats().freeBytes / PageCache::HUGE_PAGE_SIZE + 5;
+    const size_t pages = hugePages * PageCache::HUGE_PAGE_PAGES + PageCache::HUGE_PAGE_PAGES / 2;
+    [[maybe_unused]] PageCache::HugePageStats before = MemoryPool::hugePageStats();
+    PageCache::Span* span = pc.allocateSpan(pages);
+    assert(span && reinterpret_cast<uintptr_t>(span->pageAddr) % PageCache::HUGE_PAGE_SIZE == 0);
+
+    PageCache::HugePageStats stats = MemoryPool::hugePageStats();
+    assert(stats.total == before.total + hugePages + 1);
+    assert(stats.full == before.full + hugePages);
+    assert(stats.partial == before.partial + 1);
+
+    // 同一区域里剩下的半个大页紧挨着留在空闲索引里，后面的请求接着往里排
+    PageCache::Span* rest = pc.mapObjectToSpan(static_cast<char*>(span->pageAddr) + pages * PAGE_SIZE);
+    assert(rest && rest->isFree && rest->numPages == PageCache::HUGE_PAGE_PAGES / 2);
+    (void)rest;
+
+    // 释放并 trim：整块的大页被完整还给系统，不会被打碎
+    pc.deallocateSpan(span);
+    MemoryPool::trim();
+    stats = MemoryPool::hugePageStats();
+    assert(stats.full == before.full && stats.partial == before.partial);
+    assert(stats.released >= hugePages + 1 && stats.broken == 0);
+
+    MemoryPool::setHugePageMode(false);
+
+    std::cout << "Huge page mode test passed!" << std::endl;
+    std::cout<<std::endl;
+}
+
+// transfer cache 测试：一个线程整批还回来的块，另一个线程整批拿走，不经过span
+void testTransferCache()
+{
+    std::cout << "Running transfer cache test..." << std::endl;
+    std::cout<<std::endl;
+
+    const size_t size = 2816;   // 单独用一个 size-class，一批 2 块
+    const size_t count = 41;    // 慢启动下取 1 块后每次取 2 块，奇数个正好取完，本地链不剩多余的块
+
+    std::vector<void*> freed;
+    std::thread([&]() 
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            freed.push_back(MemoryPool::allocate(size));
+        }
+        for (void* p : freed)
+        {
+            MemoryPool::deallocate(p, size);
+        }
+    }).join();
+
+    // 块还留在 transfer cache 里，span 的计数没动
+    [[maybe_unused]] PageCache::Span* span = PageCache::getInstance().mapObjectToSpan(freed.back());
+    assert(span && span->useCount > 0);
+
+    // 新线程取到的是刚才还回来的那几批块，而且是整批一起拿走的
+    std::vector<void*> reused;
+    std::thread([&]() 
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            reused.push_back(MemoryPool::allocate(size));
+        }
+        for (void* p : reused)
+        {
+            MemoryPool::deallocate(p, size);
+        }
+    }).join();
+
+    std::sort(freed.begin(), freed.end());
+    std::sort(reused.begin(), reused.end());
+    assert(freed == reused);
+
+    // 退出线程整条还回来的长链按批切开：新线程慢启动第一次只要 1 块，也就只拿到 1 块
+    const size_t small = 40;
+    const size_t index = SizeClass::getIndex(small);
+    std::thread([&]() 
+    {
+        std::vector<void*> blocks;
+        for (size_t i = 0; i < 1000; ++i)
+        {
+            blocks.push_back(MemoryPool::allocate(small));
+        }
+        for (void* p : blocks)
+        {
+            MemoryPool::deallocate(p, small);
+        }
+    }).join();
+    std::thread([&]() 
+    {
+        [[maybe_unused]] size_t cached = MemoryPool::classStats(index).cachedBlocks;
+        void* p = MemoryPool::allocate(small);
+        assert(MemoryPool::classStats(index).cachedBlocks == cached);
+        MemoryPool::deallocate(p, small);
+    }).join();
+
+    CentralCache::getInstance().flushTransferCaches();
+
+    std::cout << "Transfer cache test passed!" << std::endl;
+    std::cout<<std::endl;
+}
+
+// 每 CPU 缓存测试：打开后多线程分配释放数据不串，缓存总量按核数封顶
+void testPerCpuCache()
+{
+    std::cout << "Running per-CPU cache test..." << std::endl;
+    std::cout<<std::endl;
+
+    if (!MemoryPool::setPerCpuCache(true))
+    {
+        // 没编进来或者没有 rseq，退回线程缓存
+        assert(!CpuCache::enabled());
+        std::cout << "rseq unavailable, per-CPU cache test skipped" << std::endl;
+        std::cout<<std::endl;
+        return;
+    }
+
+    // 同一 CPU 上刚释放的块马上被复用
+    void* ptr = MemoryPool::allocate(48);
+    MemoryPool::deallocate(ptr, 48);
+    [[maybe_unused]] void* again = MemoryPool::allocate(48);
+    MemoryPool::deallocate(again);
+
+    // 多个线程各自写满自己的块再校验，栈满/栈空的路径都会走到
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 8; ++t)
+    {
+        threads.emplace_back([t]() 
+        {
+            std::vector<std::pair<unsigned char*, size_t>> blocks;
+            for (size_t round = 0; round < 20; ++round)
+            {
+                for (size_t i = 0; i < 500; ++i)
+                {
+                    size_t size = 8 + (i * 37 + t * 101) % 4000;
+                    auto* p = static_cast<unsigned char*>(MemoryPool::allocate(size));
+                    std::memset(p, static_cast<int>(t + 1), size);
+                    blocks.emplace_back(p, size);
+                }
+                for (auto& [p, size] : blocks)
+                {
+                    assert(p[0] == t + 1 && p[size - 1] == t + 1);
+                    if (size % 2) MemoryPool::deallocate(p, size);
+                    else MemoryPool::deallocate(p);
+                }
+                blocks.clear();
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    // 线程都退出了，缓存的只有每个 CPU 上的那点
+    assert(CpuCache::cachedBytes() > 0);
+    assert(CpuCache::cachedBytes() <= std::thread::hardware_concurrency() * FREE_LIST_SIZE * MAX_BYTES);
+
+    MemoryPool::setPerCpuCache(false);
+    (void)ptr;
+
+    std::cout << "Per-CPU cache test passed!" << std::endl;
+    std::cout<<std::endl;
+}
+
+// 慢启动测试：第 k 次未命中取 k 块，直到一整批；本地链超长时整批还给中心缓存
+void testSlowStart()
+{
+    std::cout << "Running slow start test..." << std::endl;
+    std::cout<<std::endl;
+
+    const size_t size = 448;   // 单独用一个 size-class，一批 8 块
+    const size_t index = SizeClass::getIndex(size);
+    CentralCache::getInstance().flushTransferCaches();
+    [[maybe_unused]] ThreadCache::ClassStats before = MemoryPool::classStats(index);
+
+    std::thread([&]() 
+    {
+        // 1 + 2 + ... + 8 = 36 块正好未命中 8 次，第 k 次取 k 块，取来的正好用完，本地链上不剩
+        [[maybe_unused]] size_t cached = MemoryPool::classStats(index).cachedBlocks;
+        std::vector<void*> blocks;
+        for (size_t i = 0; i < 36; ++i)
+        {
+            blocks.push_back(MemoryPool::allocate(size));
+        }
+        assert(MemoryPool::classStats(index).misses == before.misses + 8);
+        assert(MemoryPool::classStats(index).cachedBlocks == cached);
+
+        // 之后每次取一整批
+        for (size_t i = 0; i < 8 * 4; ++i)
+        {
+            blocks.push_back(MemoryPool::allocate(size));
+        }
+        assert(MemoryPool::classStats(index).misses == before.misses + 8 + 4);
+
+        for (void* p : blocks)
+        {
+            MemoryPool::deallocate(p, size);
+        }
+        assert(MemoryPool::classStats(index).overflows > before.overflows);
+    }).join();
+
+    std::cout << "Slow start test passed!" << std::endl;
+    std::cout<<std::endl;
+}
+
+// 线程缓存总预算测试：各线程缓存的字节数不超过分到的额度，闲置线程的额度能收回
+void testThreadCacheBudget()
+{
+    std::cout << "Running thread cache budget test..." << std::endl;
+    std::cout<<std::endl;
+
+    const size_t limit = 512 * 1024;
+    [[maybe_unused]] const size_t minBytes = 64 * 1024;   // 每个线程的最低额度
+    // 前面的测试让主线程攒了不少额度，先收回来，总量从这里开始算
+    MemoryPool::shrinkIdleThreadCaches(0);
+    MemoryPool::setThreadCacheLimit(limit);
+
+    // 主线程在这一档上缓存的块，下面只看 4 个线程的
+    const size_t index = SizeClass::getIndex(256);
+    [[maybe_unused]] size_t mainCached = MemoryPool::classStats(index).cachedBlocks;
+
+    std::atomic<int> phase{0};
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([&phase]() 
+        {
+            // 每个线程各自申请释放 1MB，远超总预算
+            std::vector<void*> blocks;
+            for (size_t i = 0; i < 4096; ++i)
+            {
+                blocks.push_back(MemoryPool::allocate(256));
+            }
+            for (void* p : blocks)
+            {
+                MemoryPool::deallocate(p, 256);
+            }
+            ++phase;
+            while (phase.load() < 10) std::this_thread::yield();
+
+            // 整批申请释放：本地链上限放宽到一次要的块数，额度每轮涨一份，几轮之后整批留在本地
+            for (int round = 0; round < 4; ++round)
+            {
+                size_t got = MemoryPool::allocateBatch(256, 512, blocks.data());
+                MemoryPool::deallocateBatch(blocks.data(), got, 256);
+            }
+            ++phase;
+            while (phase.load() < 50) std::this_thread::yield();
+
+            // 额度被收回后的第一次释放把多出来的块还掉
+            MemoryPool::deallocate(MemoryPool::allocate(256), 256);
+            ++phase;
+            while (phase.load() < 100) std::this_thread::yield();
+        });
+    }
+    while (phase.load() < 4) std::this_thread::yield();
+
+    // 实际缓存的字节数不超过本地链上限之和，上限之和不超过额度；额度之和只会因为最低额度超出总上限
+    ThreadCache::BudgetStats stats = MemoryPool::threadCacheStats();
+    assert(stats.cachedBytes <= stats.capacityBytes);
+    assert(stats.capacityBytes <= stats.claimed);
+    assert(stats.claimed <= limit + stats.caches * minBytes);
+
+    // 再起一批线程，多到最低额度加起来超过总上限；它们退出后超发的最低额度不会多还回公共池
+    std::vector<std::thread> extra;
+    for (size_t t = 0; t < 8; ++t)
+    {
+        extra.emplace_back([]() { MemoryPool::deallocate(MemoryPool::allocate(256), 256); });
+    }
+    for (auto& thread : extra)
+    {
+        thread.join();
+    }
+    stats = MemoryPool::threadCacheStats();
+    assert(stats.claimed + stats.unclaimed <= limit);
+
+    // 放开总上限，各线程不用互相偷额度；每个线程整批缓存 128KB，超过最低额度
+    MemoryPool::setThreadCacheLimit(32 * 1024 * 1024);
+    phase = 10;
+    while (phase.load() < 14) std::this_thread::yield();
+    assert(MemoryPool::classStats(index).cachedBlocks > mainCached + 4 * minBytes / 256);
+
+    // 所有线程都算闲置：额度收回到最低额度
+    [[maybe_unused]] size_t reclaimed = MemoryPool::shrinkIdleThreadCaches(0);
+    stats = MemoryPool::threadCacheStats();
+    assert(reclaimed > 0 && stats.claimed == stats.caches * minBytes);
+
+    // 块还在那些线程手里，收回的额度还没进公共池，缓存着的加上公共池的不超过总上限
+    assert(stats.cachedBytes + stats.unclaimed <= 32 * 1024 * 1024);
+
+    // 线程再释放一次就真的把块还回去了，每个线程缓存的不超过最低额度
+    phase = 50;
+    while (phase.load() < 54) std::this_thread::yield();
+    assert(MemoryPool::classStats(index).cachedBlocks <= mainCached + 4 * minBytes / 256);
+
+    phase = 100;
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    MemoryPool::setThreadCacheLimit(32 * 1024 * 1024);
+
+    std::cout << "Thread cache budget test passed!" << std::endl;
+    std::cout<<std::endl;
+}
+
+// 大对象测试：超过 MAX_BYTES 的按页从 PageCache 分配，释放后缓存起来供同样大小的请求复用
+void testLargeCache()
+{
+    std::cout << "Running large cache test..." << std::endl;
+    std::cout<<std::endl;
+
+    MemoryPool::trim();
+    LargeCache::Stats before = MemoryPool::largeStats();
+    assert(before.cachedSpans == 0);
+
+    const size_t size = 1024 * 1024;
+    void* ptr = MemoryPool::allocate(size);
+    assert(ptr != nullptr && MemoryPool::usableSize(ptr) == size);
+    std::memset(ptr, 0x5a, size);
+
+    LargeCache::Stats stats = MemoryPool::largeStats();
+    assert(stats.inUseSpans == before.inUseSpans + 1);
+    assert(stats.inUseBytes == before.inUseBytes + size);
+
+    // 释放后留在缓存里，同样大小的再次申请直接拿回同一块
+    MemoryPool::deallocate(ptr, size);
+    stats = MemoryPool::largeStats();
+    assert(stats.inUseSpans == before.inUseSpans && stats.cachedBytes == size);
+
+    void* again = MemoryPool::allocate(size - 100);
+    assert(again == ptr);
+    stats = MemoryPool::largeStats();
+    assert(stats.hits == before.hits + 1 && stats.cachedSpans == 0);
+    MemoryPool::deallocate(again);
+
+    // 大出太多的缓存块不会拿来凑小请求
+    void* smaller = MemoryPool::allocate(MAX_BYTES + 1);
+    assert(smaller != ptr);
+    MemoryPool::deallocate(smaller);
+
+    // trim 时缓存的大对象全部还给 PageCache
+    MemoryPool::trim();
+    stats = MemoryPool::largeStats();
+    assert(stats.cachedSpans == 0 && stats.cachedBytes == 0);
+    (void)before;
+    (void)stats;
+
+    std::cout << "Large cache test passed!" << std::endl;
+    std::cout<<std::endl;
+}
+
+// realloc 测试：小块在原来的块里伸缩不搬家，大对象原地缩小/变大，搬家时内容完整
+void testReallocate()
+{
+    std::cout << "Running reallocate test..." << std::endl;
+    std::cout<<std::endl;
+
+    // 小块：100B 落在 112B 的块里，110B、60B 都不用搬
+    char* small = static_cast<char*>(MemoryPool::allocate(100));
+    std::memset(small, 0x21, 100);
+    assert(MemoryPool::reallocate(small, 100, 110) == small);
+    assert(MemoryPool::reallocate(small, 110, 60) == small);
+
+    // 换到更大的 size-class，前 60 字节还在
+    char* grown = static_cast<char*>(MemoryPool::reallocate(small, 60, 1000));
+    assert(grown != nullptr && MemoryPool::usableSize(grown) >= 1000);
+    for (size_t i = 0; i < 60; ++i) assert(grown[i] == 0x21);
+
+    // 不带旧大小：小块变成大对象
+    char* big = static_cast<char*>(MemoryPool::reallocate(grown, 3 * MAX_BYTES));
+    assert(big != nullptr && MemoryPool::usableSize(big) >= 3 * MAX_BYTES);
+    for (size_t i = 0; i < 60; ++i) assert(big[i] == 0x21);
+    MemoryPool::deallocate(big);
+
+    // 大对象：缩小一半原地进行，尾部还给 PageCache；再变回去时正好吞回刚才的尾巴
+    MemoryPool::trim();
+    const size_t size = 2 * 1024 * 1024;
+    char* ptr = static_cast<char*>(MemoryPool::allocate(size));
+    for (size_t i = 0; i < size; i += PAGE_SIZE) ptr[i] = static_cast<char>(i / PAGE_SIZE);
+    LargeCache::Stats before = MemoryPool::largeStats();
+
+    assert(MemoryPool::reallocate(ptr, size, size / 2) == ptr);
+    assert(MemoryPool::usableSize(ptr) == size / 2);
+    assert(MemoryPool::largeStats().inUseBytes == before.inUseBytes - size / 2);
+
+    assert(MemoryPool::reallocate(ptr, size / 2, size) == ptr);
+    assert(MemoryPool::usableSize(ptr) == size);
+    assert(MemoryPool::largeStats().inUseBytes == before.inUseBytes);
+    for (size_t i = 0; i < size / 2; i += PAGE_SIZE) assert(ptr[i] == static_cast<char>(i / PAGE_SIZE));
+
+    // 后面挡着别的对象时只能搬家（大块走 mremap），内容不变，原来的span还回去
+    void* blocker = MemoryPool::allocate(MAX_BYTES + 1);
+    char* moved = static_cast<char*>(MemoryPool::reallocate(ptr, size, 8 * size));
+    assert(moved != nullptr && MemoryPool::usableSize(moved) >= 8 * size);
+    for (size_t i = 0; i < size; i += PAGE_SIZE) assert(moved[i] == static_cast<char>(i / PAGE_SIZE));
+    moved[8 * size - 1] = 1;
+    MemoryPool::deallocate(moved);
+    MemoryPool::deallocate(blocker);
+
+    // newSize 为 0 等于释放
+    [[maybe_unused]] void* tmp = MemoryPool::allocate(32);
+    assert(MemoryPool::reallocate(tmp, 32, 0) == nullptr);
+    (void)before;
+
+    std::cout << "Reallocate test passed!" << std::endl;
+    std::cout<<std::endl;
+}
+
+// 对齐分配测试：一页以内的对齐直接落在合适的 size-class 上，没有头部；超过一页的也能按地址释放
+void testAlignedAllocation()
+{
+    std::cout << "Running aligned allocation test..." << std::endl;
+    std::cout<<std::endl;
+
+    for (size_t alignment = 1; alignment <= 1024 * 1024; alignment *= 2)
+    {
+        for (size_t size : {size_t(1), size_t(48), size_t(100), size_t(4000), size_t(70000), MAX_BYTES, MAX_BYTES + 1})
+        {
+            char* ptr = static_cast<char*>(MemoryPool::allocateAligned(size, alignment));
+            assert(ptr != nullptr && reinterpret_cast<uintptr_t>(ptr) % alignment == 0);
+            assert(MemoryPool::usableSize(ptr) >= size);
+            std::memset(ptr, 0x3c, size);
+
+            // 一半按大小释放，一半不带大小释放
+            if (size % 2) MemoryPool::deallocateAligned(ptr, size, alignment);
+            else MemoryPool::deallocate(ptr);
+        }
+    }
+
+    // 没有头部：64B 对齐的 64B 请求正好占一个 64B 的块，4KB 对齐的 4KB 请求正好一页
+    void* simd = MemoryPool::allocateAligned(64, 64);
+    assert(MemoryPool::usableSize(simd) == 64);
+    MemoryPool::deallocateAligned(simd, 64, 64);
+
+    void* page = CMemory::GetInstance()->AllocAlignedMemory(PAGE_SIZE, PAGE_SIZE, true);
+    assert(reinterpret_cast<uintptr_t>(page) % PAGE_SIZE == 0 && MemoryPool::usableSize(page) == PAGE_SIZE);
+    CMemory::GetInstance()->FreeMemory(page);
+
+    // 一批同样的对齐块互不重叠
+    std::vector<char*> blocks;
+    for (int i = 0; i < 1000; ++i)
+    {
+        char* ptr = static_cast<char*>(MemoryPool::allocateAligned(200, 256));
+        std::memset(ptr, i & 0xff, 200);
+        blocks.push_back(ptr);
+    }
+    for (int i = 0; i < 1000; ++i)
+    {
+        assert(static_cast<unsigned char>(blocks[i][0]) == (i & 0xff) &&
+               static_cast<unsigned char>(blocks[i][199]) == (i & 0xff));
+        MemoryPool::deallocateAligned(blocks[i], 200, 256);
+    }
+
+    std::cout << "Aligned allocation test passed!" << std::endl;
+    std::cout<<std::endl;
+}
+
+// STL 分配器测试：各种容器接到内存池上，结点都来自内存池；过对齐的类型也对齐；pmr 容器同样可用
+void testPoolAllocator()
+{
+    std::cout << "Running pool allocator test..." << std::endl;
+    std::cout<<std::endl;
+
+    {
+        std::vector<int, PoolAllocator<int>> vec;
+        for (int i = 0; i < 10000; ++i) vec.push_back(i);
+        assert(MemoryPool::usableSize(vec.data()) >= vec.capacity() * sizeof(int));
+
+        std::list<int, PoolAllocator<int>> list(vec.begin(), vec.end());
+        std::map<int, int, std::less<int>, PoolAllocator<std::pair<const int, int>>> map;
+        std::unordered_map<int, int, std::hash<int>, std::equal_to<int>, PoolAllocator<std::pair<const int, int>>> hashMap;
+        for (int i = 0; i < 10000; ++i)
+        {
+            map[i] = i * 2;
+            hashMap[i] = i * 3;
+        }
+        for (int i = 0; i < 10000; i += 2)
+        {
+            map.erase(i);
+            hashMap.erase(i);
+        }
+        assert(list.size() == 10000 && map.size() == 5000 && hashMap.size() == 5000);
+        assert(map[9999] == 19998 && hashMap[9999] == 29997);
+        assert(MemoryPool::usableSize(&*map.begin()) != 0);
+
+        // 分配器都相等，结点可以在容器之间直接挪
+        auto otherMap = std::move(map);
+        assert(otherMap.size() == 5000 && (PoolAllocator<int>() == PoolAllocator<double>()));
+    }
+
+    {
+        // 64B 对齐的类型按对齐分配
+        struct alignas(64) Vec4 { float v[16]; };
+        std::vector<Vec4, PoolAllocator<Vec4>> vecs(33);
+        assert(reinterpret_cast<uintptr_t>(vecs.data()) % 64 == 0);
+    }
+
+    {
+        std::pmr::vector<std::pmr::string> strings(PoolMemoryResource::getInstance());
+        for (int i = 0; i < 1000; ++i) strings.emplace_back(100, 'a' + i % 26);
+        assert(MemoryPool::usableSize(strings.data()) != 0);
+        assert(MemoryPool::usableSize(strings.back().data()) >= 100);
+
+        void* p = PoolMemoryResource::getInstance()->allocate(PAGE_SIZE, PAGE_SIZE);
+        assert(reinterpret_cast<uintptr_t>(p) % PAGE_SIZE == 0);
+        PoolMemoryResource::getInstance()->deallocate(p, PAGE_SIZE, PAGE_SIZE);
+        assert(PoolMemoryResource::getInstance()->is_equal(*PoolMemoryResource::getInstance()));
+        assert(!PoolMemoryResource::getInstance()->is_equal(*std::pmr::new_delete_resource()));
+    }
+
+    std::cout << "Pool allocator test passed!" << std::endl;
+    std::cout<<std::endl;
+}
+
+// 对象池测试：构造/析构成对调用，块就是 sizeof(T) 所在的 size-class；构造抛异常时内存还回去
+namespace
+{
+    struct Session
+    {
+        static inline int alive = 0;
+
+        Session(int id, std::string name) : id(id), name(std::move(name))
+        {
+            if (id < 0) throw std::invalid_argument("bad id");
+            ++alive;
+        }
+        ~Session() { --alive; }
+
+        int         id;
+        std::string name;
+        char        buffer[100];
+    };
+
+    struct alignas(128) CacheLine
+    {
+        char data[130];
+    };
+}
+
+void testObjectPool()
+{
+    std::cout << "Running object pool test..." << std::endl;
+    std::cout<<std::endl;
+
+    static_assert(ObjectPool<Session>::BLOCK_SIZE == sizeof(Session));
+    static_assert(ObjectPool<CacheLine>::BLOCK_SIZE % 128 == 0);
+
+    std::vector<Session*> sessions;
+    for (int i = 0; i < 1000; ++i)
+    {
+        sessions.push_back(ObjectPool<Session>::create(i, "session-" + std::to_string(i)));
+    }
+    assert(Session::alive == 1000);
+    for (int i = 0; i < 1000; ++i)
+    {
+        assert(sessions[i]->id == i && sessions[i]->name == "session-" + std::to_string(i));
+        assert(MemoryPool::usableSize(sessions[i]) == SizeClass::roundUp(sizeof(Session)));
+    }
+    for (Session* s : sessions) ObjectPool<Session>::destroy(s);
+    assert(Session::alive == 0);
+    ObjectPool<Session>::destroy(nullptr);
+
+    // 刚还回去的块马上又被拿到（本地链后进先出）
+    Session* again = ObjectPool<Session>::create(1, "again");
+    assert(again == sessions.back());
+
+    // 构造失败不漏内存：块回到本地链，下一次还是它
+    bool thrown = false;
+    try
+    {
+        ObjectPool<Session>::create(-1, "bad");
+    }
+    catch (const std::invalid_argument&)
+    {
+        thrown = true;
+    }
+    assert(thrown && Session::alive == 1);
+    void* raw = ObjectPool<Session>::allocate();
+    ObjectPool<Session>::deallocate(raw);
+    ObjectPool<Session>::destroy(again);
+
+    // 过对齐的类型
+    CacheLine* line = ObjectPool<CacheLine>::create();
+    assert(reinterpret_cast<uintptr_t>(line) % 128 == 0);
+    ObjectPool<CacheLine>::destroy(line);
+
+    // 编译期大小的接口和运行时的混用：按 N 申请，按大小/不带大小释放都行
+    void* p = MemoryPool::allocate<72>();
+    assert(MemoryPool::usableSize(p) == SizeClass::roundUp(72));
+    MemoryPool::deallocate(p, 72);
+    p = MemoryPool::allocate<MAX_BYTES + 1>();
+    assert(MemoryPool::usableSize(p) > MAX_BYTES);
+    MemoryPool::deallocate<MAX_BYTES + 1>(p);
+    (void)thrown;
+
+    std::cout << "Object pool test passed!" << std::endl;
+    std::cout<<std::endl;
+}
+
+// 批量接口测试：整批拿到的块互不重叠；本地链不够时只向中心缓存要一次；和单块接口可以混用
+void testBatchAllocation()
+{
+    std::cout << "Running batch allocation test..." << std::endl;
+    std::cout<<std::endl;
+
+    const size_t size = 176;   // 单独用一个 size-class
+    const size_t index = SizeClass::getIndex(size);
+    std::thread([&]()
+    {
+        const size_t n = 300;     // 300 * 176B 在新线程的最低额度（64KB）以内
+        std::vector<void*> ptrs(n);
+
+        // 新线程本地链是空的：一次 fetchRange 要齐
+        [[maybe_unused]] ThreadCache::ClassStats before = MemoryPool::classStats(index);
+        [[maybe_unused]] size_t got = MemoryPool::allocateBatch(size, n, ptrs.data());
+        assert(got == n);
+        assert(MemoryPool::classStats(index).misses == before.misses + 1);
+
+        for (size_t i = 0; i < n; ++i)
+        {
+            assert(ptrs[i] && MemoryPool::usableSize(ptrs[i]) == SizeClass::roundUp(size));
+            std::memset(ptrs[i], static_cast<int>(i & 0xff), size);
+        }
+        std::vector<void*> sorted(ptrs);
+        std::sort(sorted.begin(), sorted.end());
+        assert(std::adjacent_find(sorted.begin(), sorted.end()) == sorted.end());
+        for (size_t i = 0; i < n; ++i)
+        {
+            assert(static_cast<unsigned char*>(ptrs[i])[size - 1] == (i & 0xff));
+        }
+
+        // 整批还回去，再整批要：这次都在本地链上，不再找中心缓存
+        MemoryPool::deallocateBatch(ptrs.data(), n, size);
+        before = MemoryPool::classStats(index);
+        got = MemoryPool::allocateBatch(size, n, ptrs.data());
+        assert(got == n && MemoryPool::classStats(index).misses == before.misses);
+
+        // 和单块接口混用
+        void* single = MemoryPool::allocate(size);
+        MemoryPool::deallocate(ptrs[0], size);
+        ptrs[0] = single;
+        MemoryPool::deallocateBatch(ptrs.data(), n, size);
+
+        // 大对象逐块处理
+        void* large[3];
+        got = MemoryPool::allocateBatch(MAX_BYTES + 1, 3, large);
+        assert(got == 3 && large[0] != large[1] && large[1] != large[2]);
+        MemoryPool::deallocateBatch(large, 3, MAX_BYTES + 1);
+    }).join();
+
+    std::cout << "Batch allocation test passed!" << std::endl;
+    std::cout<<std::endl;
+}
+
+void testStats()
+{
+    std::cout << "Running stats test..." << std::endl;
+    std::cout<<std::endl;
+
+    const size_t size = 208;
+    [[maybe_unused]] const size_t index = SizeClass::getIndex(size);
+    const size_t n = 1000;
+    [[maybe_unused]] const PoolStats before = MemoryPool::stats();
+
+    std::thread([&]()
+    {
+        std::vector<void*> ptrs(n);
+        for (auto& p : ptrs) p = MemoryPool::allocate(size);
+
+        // 本线程的计数读的时候汇总进来
+        [[maybe_unused]] PoolStats mid = MemoryPool::stats();
+        assert(mid.classes[index].allocs == before.classes[index].allocs + n);
+        assert(mid.classes[index].frees == before.classes[index].frees);
+        assert(mid.classes[index].refills > before.classes[index].refills);
+        assert(mid.classes[index].spans > 0);
+        assert(mid.pagesInUse > before.pagesInUse);
+
+        for (auto p : ptrs) MemoryPool::deallocate(p, size);
+        mid = MemoryPool::stats();
+        assert(mid.classes[index].frees == before.classes[index].frees + n);
+        assert(mid.classes[index].threadCacheBlocks > 0);
+        assert(mid.threadCacheBytes >= mid.classes[index].threadCacheBlocks * SizeClass::classSize(index));
+    }).join();
+
+    // 线程退出后计数并入全局，不会丢
+    PoolStats after = MemoryPool::stats();
+    assert(after.classes[index].allocs == before.classes[index].allocs + n);
+    assert(after.classes[index].frees == before.classes[index].frees + n);
+    assert(after.classes[index].size == SizeClass::classSize(index));
+
+    // 大对象
+    void* large = MemoryPool::allocate(MAX_BYTES + 1);
+    after = MemoryPool::stats();
+    assert(after.largeAllocs == before.largeAllocs + 1);
+    assert(after.largeInUseBytes >= before.largeInUseBytes + MAX_BYTES + 1);
+    MemoryPool::deallocate(large, MAX_BYTES + 1);
+
+    // 映射着的每一页要么在已分配的span里，要么在空闲span里
+    after = MemoryPool::stats();
+    assert(after.mappedBytes == (after.pagesInUse + after.freePages) * PAGE_SIZE);
+    assert(after.pageHeapFreeBytes + after.pageHeapReleasedBytes == after.freePages * PAGE_SIZE);
+    assert(after.spansInUse > 0 && after.freeSpans > 0);
+
+    [[maybe_unused]] std::string text = after.toText();
+    [[maybe_unused]] std::string json = after.toJson();
+    assert(text.find("MemoryPool stats") != std::string::npos);
+    assert(json.front() == '{' && json.back() == '}');
+    assert(json.find("\"classes\":[") != std::string::npos);
+    assert(json.find("\"mapped_bytes\":" + std::to_string(after.mappedBytes)) != std::string::npos);
+
+    std::cout << "Stats test passed!" << std::endl;
+    std::cout<<std::endl;
+}
+
+void testHeapProfiler()
+{
+    std::cout << "Running heap profiler test..." << std::endl;
+    std::cout<<std::endl;
+
+    [[maybe_unused]] const HeapProfiler::Stats before = HeapProfiler::stats();
+    [[maybe_unused]] bool started = MemoryPool::startHeapProfiler(4096);
+    assert(started);
+
+    // 新线程的采样计数从 0 开始，第一次分配就能看到开关
+    std::thread([&]()
+    {
+        const size_t n = 4000; // 256KB，按 4KB 的间隔期望采样 60 多次
+        std::vector<void*> ptrs(n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            ptrs[i] = MemoryPool::allocate(64);
+            std::memset(ptrs[i], 0x5a, 64);
+        }
+
+        HeapProfiler::Stats mid = HeapProfiler::stats();
+        assert(mid.totalSamples > before.totalSamples);
+        assert(mid.liveSamples > before.liveSamples);
+        [[maybe_unused]] size_t owned = std::count_if(ptrs.begin(), ptrs.end(), HeapProfiler::owns);
+        assert(owned == mid.liveSamples - before.liveSamples);
+
+        // 采样到的小对象照样能查大小、原地 realloc、带大小或不带大小释放、混在批里释放
+        auto it = std::find_if(ptrs.begin(), ptrs.end(), HeapProfiler::owns);
+        assert(it != ptrs.end() && MemoryPool::usableSize(*it) >= 64);
+        void* grown = MemoryPool::reallocate(*it, 64, 200);
+        assert(grown && static_cast<unsigned char*>(grown)[63] == 0x5a);
+        *it = MemoryPool::reallocate(grown, 200, 64);
+        assert(*it && static_cast<unsigned char*>(*it)[63] == 0x5a);
+
+        MemoryPool::deallocateBatch(ptrs.data(), n / 4, 64);
+        for (size_t i = n / 4; i < n / 2; ++i) MemoryPool::deallocate(ptrs[i], 64);
+        for (size_t i = n / 2; i < n; ++i) MemoryPool::deallocate(ptrs[i]);
+
+        // 大对象比任何间隔都大，每次都会被采样，内存原地不动
+        void* large = MemoryPool::allocate(MAX_BYTES * 4);
+        assert(!HeapProfiler::owns(large));
+        assert(HeapProfiler::stats().liveSamples == before.liveSamples + 1);
+
+        std::string heap = MemoryPool::heapProfile();
+        assert(heap.compare(0, 14, "heap profile: ") == 0);
+        assert(heap.find("@ heap_v2/4096\n") != std::string::npos);
+        assert(heap.find("MAPPED_LIBRARIES:") != std::string::npos);
+        assert(heap.find("] @ 0x") != std::string::npos);
+
+        MemoryPool::deallocate(large);
+        mid = HeapProfiler::stats();
+        assert(mid.liveSamples == before.liveSamples && mid.liveBytes == before.liveBytes);
+
+        // 在用剖面里没有活着的采样了，累计剖面还都在
+        heap = MemoryPool::heapProfile();
+        [[maybe_unused]] std::string total = MemoryPool::allocationProfile();
+        assert(heap.find("] @ 0x") == std::string::npos);
+        assert(total.find("] @ 0x") != std::string::npos);
+
+        // 一批 256KB 按 4KB 的间隔只采样几十块，不是每块都采；采样的块排在最前面
+        mid = HeapProfiler::stats();
+        [[maybe_unused]] size_t got = MemoryPool::allocateBatch(64, n, ptrs.data());
+        assert(got == n);
+        [[maybe_unused]] size_t batchSampled = HeapProfiler::stats().liveSamples - mid.liveSamples;
+        assert(batchSampled > 1 && batchSampled < n / 8);
+        assert(std::all_of(ptrs.begin(), ptrs.begin() + batchSampled, HeapProfiler::owns));
+        assert(std::none_of(ptrs.begin() + batchSampled, ptrs.end(), HeapProfiler::owns));
+        MemoryPool::deallocateBatch(ptrs.data(), n, 64);
+        assert(HeapProfiler::stats().liveSamples == mid.liveSamples);
+    }).join();
+
+    // 关掉以后不再采样
+    MemoryPool::stopHeapProfiler();
+    std::thread([&]()
+    {
+        [[maybe_unused]] const size_t samples = HeapProfiler::stats().totalSamples;
+        for (int i = 0; i < 10000; ++i) MemoryPool::deallocate(MemoryPool::allocate(256));
+        assert(HeapProfiler::stats().totalSamples == samples);
+    }).join();
+
+    std::cout << "Heap profiler test passed!" << std::endl;
+    std::cout<<std::endl;
+}
+
 // 压力测试
 void testStress() 
 {
@@ -319,6 +1440,26 @@ int main()
         testMemoryWriting();
         testMultiThreading();
         testEdgeCases();
+        testSizeClasses();
+        testThreadExitRecycle();
+        testSpanRelease();
+        testSizelessFree();
+        testPageCacheChurn();
+        testPageCacheArenas();
+        testTrimAndScavenger();
+        testHugePageMode();
+        testLargeCache();
+        testReallocate();
+        testAlignedAllocation();
+        testPoolAllocator();
+        testObjectPool();
+        testBatchAllocation();
+        testStats();
+        testHeapProfiler();
+        testTransferCache();
+        testPerCpuCache();
+        testSlowStart();
+        testThreadCacheBudget();
         testStress();
 
         std::cout << "All tests passed successfully!" << std::endl;